@@ -0,0 +1,553 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   batch.c
+ * Desc:   Parallel offline analysis of recorded FMP4 files implementation
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmp4.h>
+
+#include "batch.h"
+#include "box.h"
+#include "fragment.h"
+#include "track.h"
+#include "metric.h"
+
+/* Media timeline to metrics clock mapping, carried across split points */
+typedef struct batch_clock_t
+{
+    uint64_t pending_wall_ms; // egwc awaiting the next moof
+    uint64_t anchor_wall_ms;
+    uint64_t anchor_media_ms;
+    bool     anchored;
+    uint64_t clock_ms;
+
+} batch_clock_t;
+
+/* Memory-mapped recording */
+typedef struct batch_file_t
+{
+    const char    *path;
+    char           name[BATCH_MAX_NAME_LEN]; // prefixes metric paths
+    uint8_t       *data;
+    size_t         size;
+    size_t         head_size; // boxes preceding the first fragment
+    track_table_t  tracks;
+
+} batch_file_t;
+
+/* Range of one recording analysed with its own metric contexts */
+typedef struct batch_job_t
+{
+    const batch_file_t *file;
+    size_t              begin;
+    size_t              end;
+    batch_clock_t       clock;
+    char               *output;
+    size_t              output_size;
+    bool                failed;
+
+} batch_job_t;
+
+/* Shared state of worker threads */
+typedef struct batch_t
+{
+    batch_job_t *jobs;
+    size_t       count;
+    size_t       next;
+    const bool  *run;
+
+} batch_t;
+
+/* Output line reference for merging */
+typedef struct batch_line_t
+{
+    uint64_t    timestamp;
+    size_t      job;
+    const char *line;
+    size_t      length;
+
+} batch_line_t;
+
+static bool batch_map(batch_file_t *file, error_context_t *errctx);
+static void batch_unmap(batch_file_t *file);
+static void batch_name(batch_file_t *file);
+static const fmp4_box_t *batch_next_box(const batch_file_t *file,
+        size_t *offset, size_t end);
+static void batch_clock_update(batch_clock_t *clock, const batch_file_t *file,
+        const fmp4_box_t *box);
+static bool batch_split(batch_file_t *file, uint64_t split_bytes,
+        batch_job_t **jobs, size_t *count, error_context_t *errctx);
+static void *batch_worker(void *arg);
+static bool batch_analyse(batch_job_t *job, const bool *run,
+        error_context_t *errctx);
+static bool batch_merge(batch_job_t *jobs, size_t count,
+        error_context_t *errctx);
+static int batch_line_compare(const void *a, const void *b);
+
+bool
+batch_run(char *const       paths[],
+          size_t            count,
+          size_t            jobs,
+          uint64_t          split_bytes,
+          const bool       *run,
+          error_context_t  *errctx)
+{
+    batch_file_t *files                   = NULL;
+    batch_t       batch                   = {};
+    pthread_t     threads[BATCH_MAX_JOBS] = {};
+    size_t        started                 = 0;
+    sigset_t      blocked                 = {};
+    sigset_t      previous                = {};
+    size_t        idx                     = 0;
+    int           ret                     = -1;
+    bool          result                  = false;
+
+    /* Sanity checks */
+    if (!paths || count == 0 || !run || !errctx)
+        error_save_jump(errctx, EINVAL, CLEANUP);
+
+    /* Map recordings & cut them into jobs at fragment boundaries */
+    files = (batch_file_t *)(calloc(count, sizeof(batch_file_t)));
+    error_save_jump_if(!files, errctx, errno, CLEANUP);
+    for (idx = 0; idx < count; idx++)
+    {
+        files[idx].path = paths[idx];
+        if (!batch_map(&(files[idx]), errctx) ||
+                !batch_split(&(files[idx]), split_bytes, &(batch.jobs),
+                    &(batch.count), errctx))
+            goto CLEANUP;
+    }
+    batch.run = run;
+
+    /* One worker per processor unless told otherwise, none idle */
+    if (jobs == 0)
+    {
+        ret = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = ret > 0 ? ret : 1;
+    }
+    jobs = MIN(MIN(jobs, BATCH_MAX_JOBS), batch.count);
+
+    /* Workers leave termination signals to the main thread */
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    (void)pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    for (started = 0; started < jobs; started++)
+    {
+        ret = pthread_create(&(threads[started]), NULL, batch_worker, &batch);
+        if (ret != 0)
+            break;
+    }
+    (void)pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    for (idx = 0; idx < started; idx++)
+        (void)pthread_join(threads[idx], NULL);
+    error_save_jump_if(started == 0, errctx, ret, CLEANUP);
+
+    /* Merge per-job output into one timestamp-ordered sequence */
+    error_save_jump_if(!*run, errctx, EINTR, CLEANUP);
+    if (!batch_merge(batch.jobs, batch.count, errctx))
+        goto CLEANUP;
+
+    /* Partial results were output, still report failed jobs */
+    for (idx = 0; idx < batch.count; idx++)
+        error_save_jump_if(batch.jobs[idx].failed, errctx, EIO, CLEANUP);
+
+    result = true;
+
+CLEANUP:
+
+    for (idx = 0; idx < batch.count; idx++)
+        FREE_AND_NULLIFY(batch.jobs[idx].output);
+    FREE_AND_NULLIFY(batch.jobs);
+    for (idx = 0; files && idx < count; idx++)
+        batch_unmap(&(files[idx]));
+    FREE_AND_NULLIFY(files);
+
+    return result;
+}
+
+static bool
+batch_map(batch_file_t    *file,
+          error_context_t *errctx)
+{
+    struct stat       info   = {};
+    const fmp4_box_t *box    = NULL;
+    size_t            offset = 0;
+    size_t            start  = 0;
+    int               fd     = -1;
+    bool              result = false;
+
+    /* Map whole recording read-only, it is scanned front to back */
+    fd = open(file->path, O_RDONLY);
+    error_save_jump_if(fd < 0, errctx, errno, CLEANUP);
+    error_save_jump_if(fstat(fd, &info) < 0, errctx, errno, CLEANUP);
+    error_save_jump_if(info.st_size < BOX_HEADER_SIZE, errctx, ENODATA,
+            CLEANUP);
+    file->size = info.st_size;
+    file->data = (uint8_t *)(mmap(NULL, file->size, PROT_READ, MAP_PRIVATE,
+                fd, 0));
+    if (file->data == MAP_FAILED)
+    {
+        file->data = NULL;
+        error_save_jump(errctx, errno, CLEANUP);
+    }
+    (void)madvise(file->data, file->size, MADV_SEQUENTIAL);
+    batch_name(file);
+
+    /* Locate track timescales & end of initialization boxes */
+    file->head_size = file->size;
+    while (true)
+    {
+        start = offset;
+        box = batch_next_box(file, &offset, file->size);
+        if (!box)
+            break;
+        if (ntohl(box->type) == BOX_TYPE_MOOV)
+            (void)track_table_parse(&(file->tracks), box);
+        if (ntohl(box->type) == BOX_TYPE_MOOF ||
+                ntohl(box->type) == BOX_TYPE_EGWC)
+        {
+            file->head_size = start;
+            break;
+        }
+    }
+
+    result = true;
+
+CLEANUP:
+
+    if (fd >= 0)
+        close(fd);
+
+    return result;
+}
+
+static void batch_unmap(batch_file_t *file)
+{
+    if (file->data)
+        (void)munmap(file->data, file->size);
+    file->data = NULL;
+}
+
+static void batch_name(batch_file_t *file)
+{
+    const char *base = strrchr(file->path, '/');
+    char       *dot  = NULL;
+    size_t      idx  = 0;
+
+    /* Base name without extension, dots would add levels to metric paths */
+    NULL_TERM_STRNCPY(file->name, base ? base + 1 : file->path,
+            sizeof(file->name));
+    dot = strrchr(file->name, '.');
+    if (dot && dot != file->name)
+        *dot = '\0';
+    for (idx = 0; file->name[idx]; idx++)
+        if (file->name[idx] == '.' || file->name[idx] == ' ')
+            file->name[idx] = '_';
+}
+
+static const fmp4_box_t *
+batch_next_box(const batch_file_t *file,
+               size_t             *offset,
+               size_t              end)
+{
+    const fmp4_box_t *box  = NULL;
+    uint64_t          size = 0;
+
+    /* Skip boxes metrics cannot take, stop at truncated tail */
+    while (end - *offset >= BOX_HEADER_SIZE)
+    {
+        box = (const fmp4_box_t *)(file->data + *offset);
+        size = box_get32(file->data + *offset);
+        if (size == 1 && end - *offset >= BOX_HEADER_SIZE + 8)
+            size = box_get64(file->data + *offset + BOX_HEADER_SIZE);
+        else if (size == 0)
+            size = end - *offset;
+        if (size < BOX_HEADER_SIZE || size > end - *offset)
+            return NULL;
+        *offset += size;
+        if (size == ntohl(box->size))
+            return box;
+    }
+
+    return NULL;
+}
+
+static void
+batch_clock_update(batch_clock_t      *clock,
+                   const batch_file_t *file,
+                   const fmp4_box_t   *box)
+{
+    error_context_t   _errctx   = {};
+    fragment_t        fragment  = {};
+    const track_t    *track     = NULL;
+    uint64_t          media_ms  = 0;
+    uint64_t          clock_ms  = 0;
+
+    /* Wallclock of encoder anchors the media time of the next fragment */
+    if (ntohl(box->type) == BOX_TYPE_EGWC)
+    {
+        clock->pending_wall_ms = fmp4_parse_wallclock(box->body,
+                ntohl(box->size), &_errctx) / 1000;
+        if (clock->clock_ms == 0)
+            clock->clock_ms = clock->pending_wall_ms;
+        return;
+    }
+    if (ntohl(box->type) != BOX_TYPE_MOOF)
+        return;
+
+    /* Decode time of first track fragment, in its track's timescale */
+    if (!fragment_parse(&fragment, box, &(file->tracks)) ||
+            !fragment.tracks[0].has_decode_time)
+        return;
+    track = track_table_find(&(file->tracks), fragment.tracks[0].track_id);
+    if (!track || !track->timescale)
+        return;
+    media_ms = track_to_ms(track, fragment.tracks[0].decode_time);
+
+    /* Media time relative to last wallclock anchor, or as is without one */
+    if (clock->pending_wall_ms)
+    {
+        clock->anchor_wall_ms = clock->pending_wall_ms;
+        clock->anchor_media_ms = media_ms;
+        clock->anchored = true;
+        clock->pending_wall_ms = 0;
+    }
+    if (clock->anchored)
+        clock_ms = clock->anchor_wall_ms + media_ms - clock->anchor_media_ms;
+    else
+        clock_ms = media_ms;
+
+    /* Metrics expect a monotonic clock, where 0 would mean wallclock */
+    clock->clock_ms = MAX(MAX(clock_ms, clock->clock_ms), 1);
+}
+
+static bool
+batch_split(batch_file_t     *file,
+            uint64_t          split_bytes,
+            batch_job_t     **jobs,
+            size_t           *count,
+            error_context_t  *errctx)
+{
+    batch_job_t      *grown  = NULL;
+    batch_clock_t     clock  = {};
+    const fmp4_box_t *box    = NULL;
+    uint32_t          type   = 0;
+    uint32_t          prev   = 0;
+    size_t            offset = file->head_size;
+    size_t            start  = 0;
+    size_t            cut    = file->head_size;
+
+    /* Whole recording is one job unless split size is given */
+    do
+    {
+        grown = (batch_job_t *)(realloc(*jobs,
+                    (*count + 1) * sizeof(batch_job_t)));
+        error_save_retval_if(!grown, errctx, errno, false);
+        *jobs = grown;
+        memset(&(grown[*count]), 0, sizeof(batch_job_t));
+        grown[*count].file = file;
+        grown[*count].begin = (cut == file->head_size) ? 0 : cut;
+        grown[*count].end = file->size;
+        grown[*count].clock = clock;
+        ++(*count);
+
+        /*
+         * Cut before a fragment once enough bytes were taken, keeping an egwc
+         * with the moof it precedes; clock state at the cut lets the next job
+         * continue the timeline where this one stops
+         */
+        for (box = NULL; split_bytes; prev = type)
+        {
+            start = offset;
+            box = batch_next_box(file, &offset, file->size);
+            if (!box)
+                break;
+            type = ntohl(box->type);
+            if (start - cut >= split_bytes && (type == BOX_TYPE_EGWC ||
+                        (type == BOX_TYPE_MOOF && prev != BOX_TYPE_EGWC)))
+            {
+                grown[*count - 1].end = cut = offset = start;
+                break;
+            }
+            batch_clock_update(&clock, file, box);
+        }
+        type = prev = 0;
+    }
+    while (box);
+
+    return true;
+}
+
+static void *batch_worker(void *arg)
+{
+    batch_t         *batch   = (batch_t *)(arg);
+    batch_job_t     *job     = NULL;
+    size_t           idx     = 0;
+    error_context_t  _errctx = {};
+    error_context_t *errctx  = &_errctx;
+
+    /* Take jobs in order until none left */
+    while (*(batch->run))
+    {
+        idx = __atomic_fetch_add(&(batch->next), 1, __ATOMIC_RELAXED);
+        if (idx >= batch->count)
+            break;
+        job = &(batch->jobs[idx]);
+        if (!batch_analyse(job, batch->run, errctx))
+        {
+            fprintf(stderr, "Batch job %zu of %s failed\n", idx,
+                    job->file->path);
+            error_log_saved(errctx);
+            errctx->saved = false;
+            job->failed = true;
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+batch_analyse(batch_job_t     *job,
+              const bool      *run,
+              error_context_t *errctx)
+{
+    const batch_file_t *file            = job->file;
+    metric_stream_t     stream          = {};
+    metric_context_t   *metric_contexts = NULL;
+    const fmp4_box_t   *box             = NULL;
+    size_t              offset          = 0;
+    bool                result          = false;
+
+    /* Output of this job is buffered until all jobs are merged */
+    stream.url = file->path;
+    stream.name = file->name[0] ? file->name : NULL;
+    stream.id = metrics_hash(file->path);
+    stream.output = open_memstream(&(job->output), &(job->output_size));
+    error_save_jump_if(!stream.output, errctx, errno, CLEANUP);
+    metrics_bind_stream(&stream);
+
+    /* Independent metric contexts per job */
+    if (!metrics_init(&metric_contexts, errctx))
+        goto CLEANUP;
+
+    /* Jobs past the first one start with the recording's init boxes */
+    stream.clock_ms = MAX(job->clock.clock_ms, 1);
+    for (offset = 0; job->begin > 0 && offset < file->head_size; )
+    {
+        box = batch_next_box(file, &offset, file->head_size);
+        if (!box)
+            break;
+        if (!metrics_feed_data(metric_contexts, box, errctx))
+            goto CLEANUP;
+    }
+
+    /* Feed boxes with media time as metrics clock */
+    for (offset = job->begin; *run; )
+    {
+        box = batch_next_box(file, &offset, job->end);
+        if (!box)
+            break;
+        batch_clock_update(&(job->clock), file, box);
+        stream.clock_ms = MAX(job->clock.clock_ms, 1);
+        if (!metrics_feed_data(metric_contexts, box, errctx))
+            goto CLEANUP;
+    }
+
+    result = true;
+
+CLEANUP:
+
+    metrics_fini(&metric_contexts);
+    metrics_bind_stream(NULL);
+    FCLOSE_AND_NULLIFY(stream.output);
+
+    return result;
+}
+
+static bool
+batch_merge(batch_job_t     *jobs,
+            size_t           count,
+            error_context_t *errctx)
+{
+    batch_line_t *lines    = NULL;
+    batch_line_t *grown    = NULL;
+    size_t        total    = 0;
+    size_t        capacity = 0;
+    const char   *line     = NULL;
+    const char   *end      = NULL;
+    const char   *stamp    = NULL;
+    size_t        idx      = 0;
+    bool          result   = false;
+
+    /* Index output lines by their trailing timestamp */
+    for (idx = 0; idx < count; idx++)
+    {
+        for (line = jobs[idx].output; line && *line; line = end + 1)
+        {
+            end = strchr(line, '\n');
+            if (!end)
+                break;
+            if (total == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 1024;
+                grown = (batch_line_t *)(realloc(lines,
+                            capacity * sizeof(batch_line_t)));
+                error_save_jump_if(!grown, errctx, errno, CLEANUP);
+                lines = grown;
+            }
+            for (stamp = end; stamp > line && stamp[-1] != ' '; stamp--);
+            lines[total].timestamp = strtoull(stamp, NULL, 10);
+            lines[total].job = idx;
+            lines[total].line = line;
+            lines[total].length = end - line + 1;
+            ++total;
+        }
+    }
+
+    /* Jobs of one recording follow each other, ties keep job & line order */
+    if (total)
+        qsort(lines, total, sizeof(batch_line_t), batch_line_compare);
+    for (idx = 0; idx < total; idx++)
+    {
+        if (fwrite(lines[idx].line, lines[idx].length, 1, stdout) != 1)
+        {
+            metrics_output_failed = true;
+            error_save_jump(errctx, errno, CLEANUP);
+        }
+    }
+    error_save_jump_if(fflush(stdout) != 0, errctx, errno, CLEANUP);
+
+    result = true;
+
+CLEANUP:
+
+    FREE_AND_NULLIFY(lines);
+
+    return result;
+}
+
+static int batch_line_compare(const void *a, const void *b)
+{
+    const batch_line_t *first  = (const batch_line_t *)(a);
+    const batch_line_t *second = (const batch_line_t *)(b);
+
+    if (first->timestamp != second->timestamp)
+        return first->timestamp < second->timestamp ? -1 : 1;
+    if (first->job != second->job)
+        return first->job < second->job ? -1 : 1;
+    if (first->line != second->line)
+        return first->line < second->line ? -1 : 1;
+
+    return 0;
+}
+
@@ -0,0 +1,36 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   batch.h
+ * Desc:   Parallel offline analysis of recorded FMP4 files header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Maximum worker threads, defaults to number of online processors */
+    #define BATCH_MAX_JOBS     256
+
+    /* Maximum length of recording names prefixing metric paths */
+    #define BATCH_MAX_NAME_LEN 128
+
+    /* Exported public functions */
+    bool batch_run(char *const paths[], size_t count, size_t jobs,
+            uint64_t split_bytes, const bool *run, error_context_t *errctx);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,133 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   box.h
+ * Desc:   ISO BMFF box type definitions & bounds-checked traversal helpers
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fmp4.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Box types in host order, as compared against ntohl(box->type) */
+    #define BOX_TYPE(a, b, c, d) \
+        (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | \
+         ((uint32_t)(c) << 8) | (uint32_t)(d))
+    #define BOX_TYPE_FTYP BOX_TYPE('f', 't', 'y', 'p')
+    #define BOX_TYPE_MOOV BOX_TYPE('m', 'o', 'o', 'v')
+    #define BOX_TYPE_MOOF BOX_TYPE('m', 'o', 'o', 'f')
+    #define BOX_TYPE_MDAT BOX_TYPE('m', 'd', 'a', 't')
+    #define BOX_TYPE_EGWC BOX_TYPE('e', 'g', 'w', 'c')
+    #define BOX_TYPE_TRAK BOX_TYPE('t', 'r', 'a', 'k')
+    #define BOX_TYPE_TKHD BOX_TYPE('t', 'k', 'h', 'd')
+    #define BOX_TYPE_MDIA BOX_TYPE('m', 'd', 'i', 'a')
+    #define BOX_TYPE_MDHD BOX_TYPE('m', 'd', 'h', 'd')
+    #define BOX_TYPE_HDLR BOX_TYPE('h', 'd', 'l', 'r')
+    #define BOX_TYPE_MINF BOX_TYPE('m', 'i', 'n', 'f')
+    #define BOX_TYPE_STBL BOX_TYPE('s', 't', 'b', 'l')
+    #define BOX_TYPE_STSD BOX_TYPE('s', 't', 's', 'd')
+    #define BOX_TYPE_MVEX BOX_TYPE('m', 'v', 'e', 'x')
+    #define BOX_TYPE_TREX BOX_TYPE('t', 'r', 'e', 'x')
+    #define BOX_TYPE_MFHD BOX_TYPE('m', 'f', 'h', 'd')
+    #define BOX_TYPE_TRAF BOX_TYPE('t', 'r', 'a', 'f')
+    #define BOX_TYPE_TFHD BOX_TYPE('t', 'f', 'h', 'd')
+    #define BOX_TYPE_TFDT BOX_TYPE('t', 'f', 'd', 't')
+    #define BOX_TYPE_TRUN BOX_TYPE('t', 'r', 'u', 'n')
+
+    /* Size of plain & full box headers */
+    #define BOX_HEADER_SIZE      (8)
+    #define FULL_BOX_HEADER_SIZE (12)
+
+    /* Cursor over sibling boxes within [pos, end) */
+    typedef struct box_iter_t
+    {
+        const uint8_t *pos;
+        const uint8_t *end;
+
+    } box_iter_t;
+
+    static inline uint32_t box_get32(const uint8_t *ptr)
+    {
+        uint32_t value = 0;
+
+        memcpy(&value, ptr, sizeof(value));
+
+        return ntohl(value);
+    }
+
+    static inline uint64_t box_get64(const uint8_t *ptr)
+    {
+        return ((uint64_t)(box_get32(ptr)) << 32) | box_get32(ptr + 4);
+    }
+
+    /* Iterate children of box, skipping header_size bytes of its header */
+    static inline box_iter_t box_children(const fmp4_box_t *box,
+            size_t header_size)
+    {
+        box_iter_t iter = {};
+        uint32_t   size = ntohl(box->size);
+
+        if (size < header_size)
+            return iter;
+        iter.pos = (const uint8_t *)(box) + header_size;
+        iter.end = (const uint8_t *)(box) + size;
+
+        return iter;
+    }
+
+    /* Returns next child, or NULL once exhausted or malformed */
+    static inline const fmp4_box_t *box_next(box_iter_t *iter)
+    {
+        const fmp4_box_t *box  = NULL;
+        uint32_t          size = 0;
+
+        if (!iter->pos || iter->end - iter->pos < BOX_HEADER_SIZE)
+            return NULL;
+        box = (const fmp4_box_t *)(iter->pos);
+        size = box_get32(iter->pos);
+        if (size < BOX_HEADER_SIZE || size > (size_t)(iter->end - iter->pos))
+        {
+            iter->pos = NULL;
+            return NULL;
+        }
+        iter->pos += size;
+
+        return box;
+    }
+
+    /* Returns first child of given type, or NULL */
+    static inline const fmp4_box_t *box_find(const fmp4_box_t *box,
+            size_t header_size, uint32_t type)
+    {
+        box_iter_t        iter  = box_children(box, header_size);
+        const fmp4_box_t *child = NULL;
+
+        while ((child = box_next(&iter)))
+            if (ntohl(child->type) == type)
+                return child;
+
+        return NULL;
+    }
+
+    /* Returns payload size of box after header_size bytes of header */
+    static inline size_t box_payload_size(const fmp4_box_t *box,
+            size_t header_size)
+    {
+        uint32_t size = ntohl(box->size);
+
+        return size > header_size ? size - header_size : 0;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,353 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   capture.c
+ * Desc:   Timestamped FMP4 box capture & replay implementation
+ */
+
+#include <unistd.h>
+
+#include "box.h"
+#include "capture.h"
+#include "metric.h"
+
+#define CAPTURE_HEADER_SIZE (4 + 2 + 2 + 2)
+
+static bool capture_put_varint(FILE *file, uint64_t value);
+static bool capture_get_varint(FILE *file, uint64_t *value);
+static bool capture_put_header(capture_t *capture, const char *name);
+static bool capture_get_header(capture_t *capture);
+
+bool
+capture_open(capture_t       *capture,
+             const char      *path,
+             const char      *name,
+             bool             header_only,
+             error_context_t *errctx)
+{
+    long size   = 0;
+    bool result = false;
+
+    /* Sanity checks */
+    if (!capture || !path || !errctx)
+        error_save_jump(errctx, EINVAL, CLEANUP);
+
+    /* Append to existing capture, keeping the flags it was created with */
+    memset(capture, 0, sizeof(*capture));
+    capture->file = fopen(path, "a+b");
+    error_save_jump_if(!capture->file, errctx, errno, CLEANUP);
+    error_save_jump_if(fseek(capture->file, 0, SEEK_END) < 0,
+            errctx, errno, CLEANUP);
+    size = ftell(capture->file);
+    error_save_jump_if(size < 0, errctx, errno, CLEANUP);
+    if (size == 0)
+    {
+        capture->flags = header_only ? CAPTURE_FLAG_HEADER_ONLY : 0;
+        error_save_jump_if(!capture_put_header(capture, name),
+                errctx, errno, CLEANUP);
+    }
+    else
+    {
+        rewind(capture->file);
+        error_save_jump_if(!capture_get_header(capture), errctx, EBADF, CLEANUP);
+        error_save_jump_if(fseek(capture->file, 0, SEEK_END) < 0,
+                errctx, errno, CLEANUP);
+    }
+
+    result = true;
+
+CLEANUP:
+
+    if (!result)
+        capture_close(capture);
+
+    return result;
+}
+
+bool
+capture_write(capture_t        *capture,
+              const fmp4_box_t *box,
+              uint64_t          receive_ms,
+              error_context_t  *errctx)
+{
+    fmp4_box_t header = {};
+    uint64_t   stored = 0;
+    uint64_t   stamp  = 0;
+
+    /* Sanity checks */
+    if (!capture || !capture->file || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Media payload may be left out, sample sizes come from trun anyway */
+    stored = ntohl(box->size);
+    error_save_retval_if(stored < sizeof(fmp4_box_t), errctx, EINVAL, false);
+    if ((capture->flags & CAPTURE_FLAG_HEADER_ONLY) &&
+            ntohl(box->type) == BOX_TYPE_MDAT)
+    {
+        header.size = htonl(sizeof(fmp4_box_t));
+        header.type = box->type;
+        box = &header;
+        stored = sizeof(fmp4_box_t);
+    }
+    error_save_retval_if(stored > MAX_CAPTURE_BOX_SIZE, errctx, EFBIG, false);
+
+    /* Time is relative to previous record, unless it is the first one */
+    if (capture->prev_ms == 0 || receive_ms < capture->prev_ms)
+        stamp = (receive_ms << 1) | 1;
+    else
+        stamp = (receive_ms - capture->prev_ms) << 1;
+    capture->prev_ms = receive_ms;
+
+    /* Append record */
+    error_save_retval_if(!capture_put_varint(capture->file, stamp) ||
+            !capture_put_varint(capture->file, stored) ||
+            fwrite(box, stored, 1, capture->file) != 1, errctx, errno, false);
+
+    /* Flush periodically so little is lost if the daemon dies */
+    if (receive_ms - capture->flushed_ms >= CAPTURE_FLUSH_INTERVAL_MS)
+    {
+        error_save_retval_if(fflush(capture->file) != 0, errctx, errno, false);
+        capture->flushed_ms = receive_ms;
+    }
+
+    return true;
+}
+
+bool
+capture_load(capture_t       *capture,
+             const char      *path,
+             error_context_t *errctx)
+{
+    /* Sanity checks */
+    if (!capture || !path || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Open capture for reading from first record */
+    memset(capture, 0, sizeof(*capture));
+    capture->file = fopen(path, "rb");
+    error_save_retval_if(!capture->file, errctx, errno, false);
+    if (!capture_get_header(capture))
+    {
+        capture_close(capture);
+        error_save_retval(errctx, EBADF, false);
+    }
+
+    return true;
+}
+
+bool
+capture_read(capture_t       *capture,
+             uint8_t        **buffer,
+             size_t          *capacity,
+             uint64_t        *receive_ms,
+             bool            *rebase,
+             error_context_t *errctx)
+{
+    uint64_t  stamp  = 0;
+    uint64_t  stored = 0;
+    uint8_t  *grown  = NULL;
+
+    /* Sanity checks */
+    if (!capture || !capture->file || !buffer || !capacity || !receive_ms ||
+            !rebase || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* End of capture is not an error */
+    if (!capture_get_varint(capture->file, &stamp))
+    {
+        error_save_retval_if(ferror(capture->file), errctx, EIO, false);
+        return false;
+    }
+
+    /* Decode record time & box length */
+    error_save_retval_if(!capture_get_varint(capture->file, &stored),
+            errctx, EBADF, false);
+    error_save_retval_if(stored < sizeof(fmp4_box_t) ||
+            stored > MAX_CAPTURE_BOX_SIZE, errctx, EBADF, false);
+    *rebase = (stamp & 1);
+    *receive_ms = (stamp & 1) ? (stamp >> 1) : capture->prev_ms + (stamp >> 1);
+    capture->prev_ms = *receive_ms;
+
+    /* Read box into buffer, growing it as needed */
+    if (stored > *capacity)
+    {
+        grown = (uint8_t *)(realloc(*buffer, stored));
+        error_save_retval_if(!grown, errctx, errno, false);
+        *buffer = grown;
+        *capacity = stored;
+    }
+    error_save_retval_if(fread(*buffer, stored, 1, capture->file) != 1,
+            errctx, EBADF, false);
+
+    /* Box never claims more than stored, e.g. stripped mdat of old captures */
+    if (ntohl(((fmp4_box_t *)(*buffer))->size) > stored)
+        ((fmp4_box_t *)(*buffer))->size = htonl((uint32_t)(stored));
+
+    return true;
+}
+
+void capture_close(capture_t *capture)
+{
+    /* Sanity checks */
+    if (!capture)
+        return;
+
+    FCLOSE_AND_NULLIFY(capture->file);
+    FREE_AND_NULLIFY(capture->name);
+}
+
+bool
+capture_replay(const char      *path,
+               double           speed,
+               const bool      *run,
+               error_context_t *errctx)
+{
+    capture_t         capture         = {};
+    metric_stream_t   stream          = {};
+    metric_context_t *metric_contexts = NULL;
+    uint8_t          *buffer          = NULL;
+    size_t            capacity        = 0;
+    uint64_t          receive_ms      = 0;
+    uint64_t          first_ms        = 0;
+    uint64_t          start_ms        = 0;
+    uint64_t          target_ms       = 0;
+    uint64_t          now_ms          = 0;
+    bool              rebase          = false;
+    bool              result          = false;
+
+    /* Sanity checks */
+    if (!path || !run || !errctx)
+        error_save_jump(errctx, EINVAL, CLEANUP);
+
+    /* Open capture, replaying under the stream name it was recorded with */
+    if (!capture_load(&capture, path, errctx))
+        goto CLEANUP;
+    stream.url = path;
+    stream.name = capture.name;
+    stream.id = metrics_hash(path);
+    metrics_bind_stream(&stream);
+
+    /* Initialize metrics */
+    if (!metrics_init(&metric_contexts, errctx))
+        goto CLEANUP;
+
+    /* Feed boxes with recorded time as metrics clock */
+    while (*run && capture_read(&capture, &buffer, &capacity, &receive_ms,
+                &rebase, errctx))
+    {
+        /* Pace to recorded timing unless at maximum speed */
+        now_ms = current_time_milliseconds();
+        if (rebase || start_ms == 0)
+        {
+            start_ms = now_ms;
+            first_ms = receive_ms;
+        }
+        if (speed > 0)
+        {
+            target_ms = start_ms + (uint64_t)((double)(receive_ms - first_ms) / speed);
+            if (target_ms > now_ms)
+                usleep((target_ms - now_ms) * 1000);
+        }
+
+        stream.clock_ms = receive_ms;
+        if (!metrics_feed_data(metric_contexts, (const fmp4_box_t *)(buffer),
+                    errctx))
+            goto CLEANUP;
+    }
+
+    result = !errctx->saved;
+
+CLEANUP:
+
+    metrics_fini(&metric_contexts);
+    metrics_bind_stream(NULL);
+    capture_close(&capture);
+    FREE_AND_NULLIFY(buffer);
+
+    return result;
+}
+
+static bool capture_put_varint(FILE *file, uint64_t value)
+{
+    uint8_t bytes[10] = {0};
+    size_t  length    = 0;
+
+    /* Unsigned LEB128 */
+    do
+    {
+        bytes[length] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        value >>= 7;
+        ++length;
+    }
+    while (value);
+
+    return fwrite(bytes, length, 1, file) == 1;
+}
+
+static bool capture_get_varint(FILE *file, uint64_t *value)
+{
+    int    byte  = 0;
+    size_t shift = 0;
+
+    for (*value = 0, shift = 0; shift < 64; shift += 7)
+    {
+        byte = fgetc(file);
+        if (byte == EOF)
+            return false;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+static bool capture_put_header(capture_t *capture, const char *name)
+{
+    uint8_t  header[CAPTURE_HEADER_SIZE] = {0};
+    uint32_t magic                       = htonl(CAPTURE_MAGIC);
+    uint16_t version                     = htons(CAPTURE_VERSION);
+    uint16_t flags                       = htons(capture->flags);
+    uint16_t length                      = htons(name ? strlen(name) : 0);
+
+    memcpy(header, &magic, 4);
+    memcpy(header + 4, &version, 2);
+    memcpy(header + 6, &flags, 2);
+    memcpy(header + 8, &length, 2);
+    if (fwrite(header, sizeof(header), 1, capture->file) != 1)
+        return false;
+    if (name && fwrite(name, ntohs(length), 1, capture->file) != 1)
+        return false;
+
+    return fflush(capture->file) == 0;
+}
+
+static bool capture_get_header(capture_t *capture)
+{
+    uint8_t  header[CAPTURE_HEADER_SIZE] = {0};
+    uint32_t magic                       = 0;
+    uint16_t version                     = 0;
+    uint16_t flags                       = 0;
+    uint16_t length                      = 0;
+
+    /* Validate fixed header */
+    if (fread(header, sizeof(header), 1, capture->file) != 1)
+        return false;
+    memcpy(&magic, header, 4);
+    memcpy(&version, header + 4, 2);
+    memcpy(&flags, header + 6, 2);
+    memcpy(&length, header + 8, 2);
+    if (ntohl(magic) != CAPTURE_MAGIC || ntohs(version) != CAPTURE_VERSION)
+        return false;
+    capture->flags = ntohs(flags);
+
+    /* Read stream name, if recorded */
+    if (ntohs(length) == 0)
+        return true;
+    capture->name = (char *)(calloc(1, ntohs(length) + 1));
+    if (!capture->name)
+        return false;
+
+    return fread(capture->name, ntohs(length), 1, capture->file) == 1;
+}
+
@@ -0,0 +1,71 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   capture.h
+ * Desc:   Timestamped FMP4 box capture & replay header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <fmp4.h>
+
+#include "common.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Capture file identification */
+    #define CAPTURE_MAGIC   0x50433446 // "F4CP"
+    #define CAPTURE_VERSION 1
+
+    /* Capture file flags */
+    #define CAPTURE_FLAG_HEADER_ONLY 0x0001 // mdat stored without payload
+
+    /* Largest box stored in or read back from a capture */
+    #define MAX_CAPTURE_BOX_SIZE (64 * 1024 * 1024)
+
+    /* Interval of flushing captured records to disk */
+    #define CAPTURE_FLUSH_INTERVAL_MS (1000)
+
+    /*
+     * File layout, all integers big-endian:
+     *   header: magic u32, version u16, flags u16, name length u16, name
+     *   record: varint (time << 1 | absolute), varint stored length, box
+     * Record time is absolute for the first record appended per session and
+     * relative to the previous record otherwise.
+     */
+    typedef struct capture_t
+    {
+        FILE     *file;
+        char     *name;       // stream name recorded in header, if any
+        uint16_t  flags;
+        uint64_t  prev_ms;
+        uint64_t  flushed_ms;
+
+    } capture_t;
+
+    /* Exported public functions */
+    bool capture_open(capture_t *capture, const char *path, const char *name,
+            bool header_only, error_context_t *errctx);
+    bool capture_write(capture_t *capture, const fmp4_box_t *box,
+            uint64_t receive_ms, error_context_t *errctx);
+    bool capture_load(capture_t *capture, const char *path,
+            error_context_t *errctx);
+    bool capture_read(capture_t *capture, uint8_t **buffer, size_t *capacity,
+            uint64_t *receive_ms, bool *rebase, error_context_t *errctx);
+    void capture_close(capture_t *capture);
+    bool capture_replay(const char *path, double speed, const bool *run,
+            error_context_t *errctx);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,280 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   cluster.c
+ * Desc:   Consistent-hashing stream assignment across daemons implementation
+ */
+
+#include <math.h>
+#include <sys/stat.h>
+
+#include "cluster.h"
+
+/* Point on the hash ring owned by a member */
+typedef struct ring_point_t
+{
+    uint64_t hash;
+    size_t   member;
+
+} ring_point_t;
+
+/* Stream in assignment order */
+typedef struct stream_order_t
+{
+    uint64_t hash;
+    size_t   stream;
+
+} stream_order_t;
+
+static uint64_t cluster_mix(uint64_t hash);
+static int ring_point_compare(const void *a, const void *b);
+static int stream_order_compare(const void *a, const void *b);
+static void cluster_members_free(char **members, size_t count);
+
+bool cluster_load(cluster_t *cluster, error_context_t *errctx)
+{
+    struct stat   st                              = {};
+    FILE         *file                            = NULL;
+    char         *line                            = NULL;
+    size_t        length                          = 0;
+    char          name[MAX_MEMBER_NAME_LEN + 1]   = {0};
+    char        **members                         = NULL;
+    char        **grown                           = NULL;
+    size_t        count                           = 0;
+    size_t        idx                             = 0;
+    bool          result                          = false;
+
+    /* Sanity checks */
+    if (!cluster || !cluster->path || !errctx)
+        error_save_jump(errctx, EINVAL, CLEANUP);
+
+    /* Each line names one member, blank lines & '#' comments ignored */
+    file = fopen(cluster->path, "r");
+    error_save_jump_if(!file, errctx, errno, CLEANUP);
+    error_save_jump_if(fstat(fileno(file), &st) < 0, errctx, errno, CLEANUP);
+    while (getline(&line, &length, file) > 0)
+    {
+        if (sscanf(line, " %1[#]", name) == 1)
+            continue;
+        if (sscanf(line, "%" STRINGIFY(MAX_MEMBER_NAME_LEN) "s", name) != 1)
+            continue;
+        for (idx = 0; idx < count; idx++)
+            if (strcmp(members[idx], name) == 0)
+                break;
+        if (idx < count)
+            continue; // duplicate member
+        grown = (char **)(realloc(members, (count + 1) * sizeof(char *)));
+        error_save_jump_if(!grown, errctx, errno, CLEANUP);
+        members = grown;
+        members[count] = strdup(name);
+        error_save_jump_if(!members[count], errctx, errno, CLEANUP);
+        ++count;
+    }
+
+    /* Replace previous membership */
+    cluster_members_free(cluster->members, cluster->count);
+    cluster->members = members;
+    cluster->count = count;
+    cluster->mtime = st.st_mtim;
+    members = NULL;
+    count = 0;
+
+    result = true;
+
+CLEANUP:
+
+    cluster_members_free(members, count);
+    FREE_AND_NULLIFY(line);
+    FCLOSE_AND_NULLIFY(file);
+
+    return result;
+}
+
+bool cluster_changed(const cluster_t *cluster)
+{
+    struct stat st = {};
+
+    /* Sanity checks */
+    if (!cluster || !cluster->path)
+        return false;
+
+    /* Unreadable file keeps current membership */
+    if (stat(cluster->path, &st) < 0)
+        return false;
+
+    return st.st_mtim.tv_sec != cluster->mtime.tv_sec ||
+           st.st_mtim.tv_nsec != cluster->mtime.tv_nsec;
+}
+
+bool
+cluster_assign(const cluster_t     *cluster,
+               const stream_list_t *list,
+               bool                *owned,
+               error_context_t     *errctx)
+{
+    ring_point_t   *ring     = NULL;
+    stream_order_t *order    = NULL;
+    const stream_t *stream   = NULL;
+    size_t         *loads    = NULL;
+    char            key[MAX_MEMBER_NAME_LEN + 32] = {0};
+    size_t          points   = 0;
+    size_t          capacity = 0;
+    size_t          self     = SIZE_MAX;
+    size_t          idx      = 0;
+    size_t          pos      = 0;
+    size_t          low      = 0;
+    size_t          high     = 0;
+    size_t          probe    = 0;
+    size_t          size     = 0;
+    size_t          least    = 0;
+    bool            result   = false;
+
+    /* Sanity checks */
+    if (!cluster || !list || !owned || !errctx)
+        error_save_jump(errctx, EINVAL, CLEANUP);
+
+    /* Without membership this daemon owns nothing */
+    memset(owned, 0, list->count * sizeof(bool));
+    for (idx = 0; idx < cluster->count; idx++)
+        if (cluster->self && strcmp(cluster->members[idx], cluster->self) == 0)
+            self = idx;
+    if (cluster->count == 0 || list->count == 0 || self == SIZE_MAX)
+        return true;
+
+    /* Place virtual nodes of every member on the ring */
+    points = cluster->count * CLUSTER_VIRTUAL_NODES;
+    ring = (ring_point_t *)(calloc(points, sizeof(ring_point_t)));
+    order = (stream_order_t *)(calloc(list->count, sizeof(stream_order_t)));
+    loads = (size_t *)(calloc(cluster->count, sizeof(size_t)));
+    error_save_jump_if(!ring || !order || !loads, errctx, errno, CLEANUP);
+    for (idx = 0; idx < points; idx++)
+    {
+        (void)snprintf(key, sizeof(key), "%s#%zu",
+                cluster->members[idx / CLUSTER_VIRTUAL_NODES],
+                idx % CLUSTER_VIRTUAL_NODES);
+        ring[idx].hash = cluster_mix(metrics_hash(key));
+        ring[idx].member = idx / CLUSTER_VIRTUAL_NODES;
+    }
+    qsort(ring, points, sizeof(ring_point_t), ring_point_compare);
+
+    /*
+     * Every daemon must visit streams in the same order regardless of list;
+     * streams of a group hash alike so that they end up next to each other
+     */
+    for (idx = 0; idx < list->count; idx++)
+    {
+        order[idx].hash = cluster_mix(list->streams[idx].metric.group ?
+                list->streams[idx].metric.group : list->streams[idx].metric.id);
+        order[idx].stream = idx;
+    }
+    qsort(order, list->count, sizeof(stream_order_t), stream_order_compare);
+
+    /* Bounded loads, no member takes more than load factor times its share */
+    capacity = (size_t)(ceil(cluster->load_factor *
+                (double)(list->count) / (double)(cluster->count)));
+    capacity = MAX(capacity, 1);
+
+    /*
+     * Walk clockwise from each stream to first member with room for it, a
+     * group taken as one unit of its size so that it is correlated locally;
+     * a group too large for any member goes to the least loaded one met
+     */
+    for (idx = 0; idx < list->count; idx += size)
+    {
+        stream = &(list->streams[order[idx].stream]);
+        size = 1;
+        while (stream->metric.group && idx + size < list->count &&
+                list->streams[order[idx + size].stream].metric.group ==
+                stream->metric.group)
+            ++size;
+        for (low = 0, high = points; low < high; )
+        {
+            pos = low + (high - low) / 2;
+            if (ring[pos].hash < order[idx].hash)
+                low = pos + 1;
+            else
+                high = pos;
+        }
+        for (probe = 0, least = low % points; probe < points; probe++)
+        {
+            pos = (low + probe) % points;
+            if (loads[ring[pos].member] + size <= capacity)
+                break;
+            if (loads[ring[pos].member] < loads[ring[least].member])
+                least = pos;
+        }
+        if (probe == points)
+            pos = least;
+        loads[ring[pos].member] += size;
+        for (probe = idx; probe < idx + size; probe++)
+            owned[order[probe].stream] = (ring[pos].member == self);
+    }
+
+    result = true;
+
+CLEANUP:
+
+    FREE_AND_NULLIFY(ring);
+    FREE_AND_NULLIFY(order);
+    FREE_AND_NULLIFY(loads);
+
+    return result;
+}
+
+void cluster_free(cluster_t *cluster)
+{
+    /* Sanity checks */
+    if (!cluster)
+        return;
+
+    cluster_members_free(cluster->members, cluster->count);
+    cluster->members = NULL;
+    cluster->count = 0;
+}
+
+static uint64_t cluster_mix(uint64_t hash)
+{
+    /* SplitMix64 finalizer, spreads similar names evenly around the ring */
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+static int ring_point_compare(const void *a, const void *b)
+{
+    const ring_point_t *pa = (const ring_point_t *)(a);
+    const ring_point_t *pb = (const ring_point_t *)(b);
+
+    if (pa->hash != pb->hash)
+        return pa->hash < pb->hash ? -1 : 1;
+
+    return pa->member < pb->member ? -1 : (pa->member > pb->member);
+}
+
+static int stream_order_compare(const void *a, const void *b)
+{
+    const stream_order_t *sa = (const stream_order_t *)(a);
+    const stream_order_t *sb = (const stream_order_t *)(b);
+
+    if (sa->hash != sb->hash)
+        return sa->hash < sb->hash ? -1 : 1;
+
+    return sa->stream < sb->stream ? -1 : (sa->stream > sb->stream);
+}
+
+static void cluster_members_free(char **members, size_t count)
+{
+    size_t idx = 0;
+
+    if (!members)
+        return;
+
+    for (idx = 0; idx < count; idx++)
+        FREE_AND_NULLIFY(members[idx]);
+    free(members);
+}
+
@@ -0,0 +1,54 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   cluster.h
+ * Desc:   Consistent-hashing stream assignment across daemons header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+#include "error.h"
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Ring points per member, and default bounded load factor */
+    #define CLUSTER_VIRTUAL_NODES       (64)
+    #define CLUSTER_DEFAULT_LOAD_FACTOR (1.25)
+
+    /* Maximum length of member name */
+    #define MAX_MEMBER_NAME_LEN 128
+
+    /* Cluster membership, shared by all daemons through one file */
+    typedef struct cluster_t
+    {
+        const char      *path;
+        const char      *self;
+        double           load_factor;
+        char           **members;
+        size_t           count;
+        struct timespec  mtime;
+
+    } cluster_t;
+
+    /* Exported public functions */
+    bool cluster_load(cluster_t *cluster, error_context_t *errctx);
+    bool cluster_changed(const cluster_t *cluster);
+    bool cluster_assign(const cluster_t *cluster, const stream_list_t *list,
+            bool *owned, error_context_t *errctx);
+    void cluster_free(cluster_t *cluster);
+
+#ifdef __cplusplus
+}
+#endif
+
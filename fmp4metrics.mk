@@ -20,33 +20,96 @@ else ifeq ($(OS),darwin)
 	LDFLAGS += -all_load
 	LDFLAGS += -lrtmp -lavformat -lavcodec -lavutil -lwebsockets -lz -luv -lev -lssl -lcrypto
 endif
+LDFLAGS += -lpthread -lm
 
-OBJS = main.o \
-	   metric.o \
-	   frames_per_second.o \
+ifeq ($(OS),linux)
+	STATIC := -static
+	STREAM_LDFLAGS := -Wl,--wrap=connect -Wl,--wrap=getaddrinfo
+endif
+
+CORE_OBJS = metric.o \
+	   metric_table.o \
+	   stream.o \
+	   cluster.o \
+	   capture.o \
+	   batch.o \
+	   fragment.o \
+	   track.o \
+	   window.o \
+	   sink.o \
+	   history.o \
+	   overload.o
+
+METRIC_OBJS = frames_per_second.o \
 	   frame_interarrival_time.o \
 	   media_stream_bitrate.o \
-	   q2q_stream_latency.o
+	   q2q_stream_latency.o \
+	   media_pacing.o \
+	   keyframe_cadence.o \
+	   startup_phases.o \
+	   player_buffer.o \
+	   tcp_info.o \
+	   fragment_sequence.o \
+	   hop_latency.o \
+	   ladder_alignment.o
+
+OBJS = main.o $(CORE_OBJS) $(METRIC_OBJS)
+
+TABLE_OBJS = table_reader.o \
+	   metric_table.o
 
-.PHONY: all libfmp4 linux darwin clean
+# Metric modules compiled into statically dispatched pipeline builds
+METRICS ?= $(METRIC_OBJS:.o=)
+PIPELINE_OBJS = $(CORE_OBJS:.o=.static.o) \
+	   $(METRICS:=.static.o) \
+	   metric_pipeline.static.o
 
-all: $(OS)
+.PHONY: all libfmp4 linux darwin table static bench FORCE clean
+
+all: $(OS) table
 
 %.o: %.c %.h
 	$(CC) -c -o $@ $(CFLAGS) $<
 
+%.static.o: %.c metric_pipeline_list.h
+	$(CC) -c -o $@ $(CFLAGS) -DMETRIC_STATIC_PIPELINE $<
+
+metric_pipeline_list.h: FORCE
+	@echo "/* Generated by $(BIN).mk for METRICS=\"$(METRICS)\" */" > $@.tmp
+	@echo "#define METRIC_PIPELINE(X) \\" >> $@.tmp
+	@for m in $(METRICS); do \
+		sed -n 's/^REGISTER_METRIC(\(.*\));/    X(\1) \\/p' $$m.c; \
+	done >> $@.tmp
+	@echo "" >> $@.tmp
+	@cmp -s $@.tmp $@ && rm -f $@.tmp || mv -f $@.tmp $@
+
 libfmp4:
 	$(MAKE) -C libfmp4
 
 linux: libfmp4 $(OBJS)
-	$(CC) -static -o $(BIN) $(OBJS) $(LDFLAGS)
+	$(CC) -static -o $(BIN) $(OBJS) $(STREAM_LDFLAGS) $(LDFLAGS)
 
 darwin: libfmp4 $(OBJS)
 	$(CC) -o $(BIN) $(OBJS) libfmp4/*.o libfmp4/cJSON/cJSON.o $(LDFLAGS)
 
+table: libfmp4 $(TABLE_OBJS)
+	$(CC) -o $(BIN)-table $(TABLE_OBJS) $(LDFLAGS)
+
+static: libfmp4 main.static.o $(PIPELINE_OBJS)
+	$(CC) $(STATIC) -o $(BIN)-static main.static.o $(PIPELINE_OBJS) \
+		$(STREAM_LDFLAGS) $(LDFLAGS)
+
+bench: libfmp4 metric_bench.o metric_bench.static.o $(CORE_OBJS) $(METRIC_OBJS) $(PIPELINE_OBJS)
+	$(CC) $(STATIC) -o $(BIN)-bench metric_bench.o $(CORE_OBJS) $(METRIC_OBJS) \
+		$(STREAM_LDFLAGS) $(LDFLAGS)
+	$(CC) $(STATIC) -o $(BIN)-bench-static metric_bench.static.o \
+		$(PIPELINE_OBJS) $(STREAM_LDFLAGS) $(LDFLAGS)
+	./$(BIN)-bench
+	./$(BIN)-bench-static
+
 clean:
 	$(MAKE) -C libfmp4 clean
-	rm -f *.o
-	rm -f $(BIN)
+	rm -f *.o metric_pipeline_list.h
+	rm -f $(BIN) $(BIN)-table $(BIN)-static $(BIN)-bench $(BIN)-bench-static
 
 
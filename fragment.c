@@ -0,0 +1,362 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   fragment.c
+ * Desc:   Movie fragment sample table summary implementation
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define FRAGMENT_SSSE3
+#endif
+
+#include "box.h"
+#include "fragment.h"
+
+/* Sample defaults of a track fragment, indexed by trun table field */
+#define DEFAULT_DURATION 0
+#define DEFAULT_SIZE     1
+#define DEFAULT_FLAGS    2
+
+/* Track run sample tables are summed in blocks of every possible stride */
+#define SAMPLE_BLOCK_SIZE  48
+#define SAMPLE_BLOCK_WORDS (SAMPLE_BLOCK_SIZE / 4)
+
+static fragment_track_t *fragment_track_add(fragment_t *fragment,
+        uint32_t track_id);
+static void fragment_parse_traf(fragment_t *fragment, const fmp4_box_t *traf,
+        const track_table_t *tracks);
+static void fragment_parse_trun(fragment_track_t *track, const fmp4_box_t *trun,
+        const uint32_t defaults[3]);
+static void fragment_scan_sync(fragment_track_t *track, const uint8_t *table,
+        uint32_t count, uint32_t flags, uint32_t first_flags,
+        const uint32_t defaults[3]);
+#ifdef FRAGMENT_SSSE3
+static size_t fragment_sum_ssse3(const uint8_t *table, size_t blocks,
+        uint64_t words[SAMPLE_BLOCK_WORDS]);
+#endif
+
+bool
+fragment_parse(fragment_t          *fragment,
+               const fmp4_box_t    *moof,
+               const track_table_t *tracks)
+{
+    box_iter_t        iter  = {};
+    const fmp4_box_t *child = NULL;
+
+    /* Sanity checks */
+    if (!fragment || !moof)
+        return false;
+
+    /* Totals of every track fragment, merged per track */
+    fragment->sequence = 0;
+    fragment->track_count = 0;
+    iter = box_children(moof, BOX_HEADER_SIZE);
+    while ((child = box_next(&iter)))
+    {
+        switch (ntohl(child->type))
+        {
+            case BOX_TYPE_MFHD:
+                if (box_payload_size(child, FULL_BOX_HEADER_SIZE) >= 4)
+                    fragment->sequence = box_get32((const uint8_t *)(child) +
+                            FULL_BOX_HEADER_SIZE);
+                break;
+            case BOX_TYPE_TRAF:
+                fragment_parse_traf(fragment, child, tracks);
+                break;
+            default:
+                break;
+        }
+    }
+
+    return fragment->track_count > 0;
+}
+
+const fragment_track_t *
+fragment_track(const fragment_t *fragment,
+               uint32_t          track_id)
+{
+    size_t idx = 0;
+
+    for (idx = 0; fragment && idx < fragment->track_count; idx++)
+        if (fragment->tracks[idx].track_id == track_id)
+            return &(fragment->tracks[idx]);
+
+    return NULL;
+}
+
+void
+fragment_sum_samples(const uint8_t *table,
+                     size_t         count,
+                     size_t         stride,
+                     uint64_t       sums[4])
+{
+    uint64_t words[SAMPLE_BLOCK_WORDS] = {0};
+    size_t   blocks                    = 0;
+    size_t   idx                       = 0;
+    size_t   field                     = 0;
+
+    /* Sanity checks */
+    memset(sums, 0, 4 * sizeof(uint64_t));
+    if (!table || stride == 0 || stride > 16 || stride % 4 != 0)
+        return;
+
+    /*
+     * Every stride of 4 to 16 bytes divides the block size, so each word
+     * position within a block always holds the same field; blocks are summed
+     * per word position, then folded into per-field sums
+     */
+#ifdef FRAGMENT_SSSE3
+    if (__builtin_cpu_supports("ssse3"))
+        blocks = fragment_sum_ssse3(table, count * stride / SAMPLE_BLOCK_SIZE,
+                words);
+#endif
+    for (idx = 0; idx < SAMPLE_BLOCK_WORDS; idx++)
+        sums[(idx * 4 % stride) / 4] += words[idx];
+
+    /* Remaining samples, or all of them without SIMD support */
+    for (idx = blocks * SAMPLE_BLOCK_SIZE / stride; idx < count; idx++)
+        for (field = 0; field < stride / 4; field++)
+            sums[field] += box_get32(table + idx * stride + field * 4);
+}
+
+static fragment_track_t *
+fragment_track_add(fragment_t *fragment,
+                   uint32_t    track_id)
+{
+    fragment_track_t *track = (fragment_track_t *)(fragment_track(fragment,
+                track_id));
+
+    if (track || fragment->track_count == MAX_FRAGMENT_TRACKS)
+        return track;
+    track = &(fragment->tracks[fragment->track_count++]);
+    memset(track, 0, sizeof(*track));
+    track->track_id = track_id;
+
+    return track;
+}
+
+static void
+fragment_parse_traf(fragment_t          *fragment,
+                    const fmp4_box_t    *traf,
+                    const track_table_t *tracks)
+{
+    const fmp4_box_t *tfhd             = NULL;
+    const fmp4_box_t *child            = NULL;
+    const track_t    *trex             = NULL;
+    fragment_track_t *track            = NULL;
+    box_iter_t        iter             = {};
+    const uint8_t    *field            = NULL;
+    const uint8_t    *end              = NULL;
+    uint32_t          flags            = 0;
+    uint32_t          defaults[3]      = {0};
+
+    /* Track fragment header names track */
+    tfhd = box_find(traf, BOX_HEADER_SIZE, BOX_TYPE_TFHD);
+    if (!tfhd || box_payload_size(tfhd, FULL_BOX_HEADER_SIZE) < 4)
+        return;
+    field = (const uint8_t *)(tfhd) + FULL_BOX_HEADER_SIZE;
+    end = (const uint8_t *)(tfhd) + ntohl(tfhd->size);
+    flags = box_get32((const uint8_t *)(tfhd) + BOX_HEADER_SIZE) & 0xffffff;
+    track = fragment_track_add(fragment, box_get32(field));
+    if (!track)
+        return;
+
+    /* Sample defaults of tfhd override those of trex */
+    trex = track_table_find(tracks, track->track_id);
+    defaults[DEFAULT_DURATION] = trex ? trex->default_duration : 0;
+    defaults[DEFAULT_SIZE] = trex ? trex->default_size : 0;
+    defaults[DEFAULT_FLAGS] = trex ? trex->default_flags : 0;
+    field += 4;
+    field += (flags & TFHD_BASE_DATA_OFFSET) ? 8 : 0;
+    field += (flags & TFHD_SAMPLE_DESCRIPTION_INDEX) ? 4 : 0;
+    if ((flags & TFHD_DEFAULT_SAMPLE_DURATION) && end - field >= 4)
+    {
+        defaults[DEFAULT_DURATION] = box_get32(field);
+        field += 4;
+    }
+    if ((flags & TFHD_DEFAULT_SAMPLE_SIZE) && end - field >= 4)
+    {
+        defaults[DEFAULT_SIZE] = box_get32(field);
+        field += 4;
+    }
+    if ((flags & TFHD_DEFAULT_SAMPLE_FLAGS) && end - field >= 4)
+        defaults[DEFAULT_FLAGS] = box_get32(field);
+
+    /* Decode time & runs of samples */
+    iter = box_children(traf, BOX_HEADER_SIZE);
+    while ((child = box_next(&iter)))
+    {
+        if (ntohl(child->type) == BOX_TYPE_TFDT && !track->has_decode_time)
+        {
+            field = (const uint8_t *)(child) + FULL_BOX_HEADER_SIZE;
+            if (((const fmp4_full_box_t *)(child))->version == 1 &&
+                    box_payload_size(child, FULL_BOX_HEADER_SIZE) >= 8)
+                track->decode_time = box_get64(field);
+            else if (box_payload_size(child, FULL_BOX_HEADER_SIZE) >= 4)
+                track->decode_time = box_get32(field);
+            else
+                continue;
+            track->has_decode_time = true;
+        }
+        else if (ntohl(child->type) == BOX_TYPE_TRUN)
+            fragment_parse_trun(track, child, defaults);
+    }
+}
+
+static void
+fragment_parse_trun(fragment_track_t *track,
+                    const fmp4_box_t *trun,
+                    const uint32_t    defaults[3])
+{
+    const uint8_t *field       = (const uint8_t *)(trun) + FULL_BOX_HEADER_SIZE;
+    uint64_t       sums[4]     = {0};
+    size_t         payload     = box_payload_size(trun, FULL_BOX_HEADER_SIZE);
+    size_t         header      = 4;
+    size_t         stride      = 0;
+    uint32_t       flags       = 0;
+    uint32_t       count       = 0;
+    uint32_t       first_flags = 0;
+
+    /* Locate per-sample table past optional run fields */
+    if (payload < header)
+        return;
+    flags = box_get32((const uint8_t *)(trun) + BOX_HEADER_SIZE) & 0xffffff;
+    count = box_get32(field);
+    header += (flags & TRUN_DATA_OFFSET) ? 4 : 0;
+    header += (flags & TRUN_FIRST_SAMPLE_FLAGS) ? 4 : 0;
+    stride = 4 * __builtin_popcount(flags & (TRUN_SAMPLE_DURATION |
+                TRUN_SAMPLE_SIZE | TRUN_SAMPLE_FLAGS | TRUN_SAMPLE_CTO));
+    if (payload < header || (stride && count > (payload - header) / stride))
+        return;
+    if (flags & TRUN_FIRST_SAMPLE_FLAGS)
+        first_flags = box_get32(field + header - 4);
+
+    /* Sync samples are located before totals move past this run */
+    fragment_scan_sync(track, field + header, count, flags, first_flags,
+            defaults);
+
+    /* Fields absent from the table take the track fragment defaults */
+    fragment_sum_samples(field + header, count, stride, sums);
+    track->sample_count += count;
+    if (flags & TRUN_SAMPLE_DURATION)
+        track->duration += sums[0];
+    else
+        track->duration += (uint64_t)(count) * defaults[DEFAULT_DURATION];
+    if (flags & TRUN_SAMPLE_SIZE)
+        track->sample_bytes += sums[(flags & TRUN_SAMPLE_DURATION) ? 1 : 0];
+    else
+        track->sample_bytes += (uint64_t)(count) * defaults[DEFAULT_SIZE];
+}
+
+static void
+fragment_scan_sync(fragment_track_t *track,
+                   const uint8_t    *table,
+                   uint32_t          count,
+                   uint32_t          flags,
+                   uint32_t          first_flags,
+                   const uint32_t    defaults[3])
+{
+    const uint8_t *record      = table;
+    size_t         stride      = 0;
+    size_t         flags_field = 0;
+    uint64_t       offset      = track->duration;
+    uint32_t       sample      = 0;
+    uint32_t       sample_flag = 0;
+    bool           per_sample  = (flags & TRUN_SAMPLE_FLAGS);
+
+    /* Per-sample flags follow duration & size fields of a record */
+    stride = 4 * __builtin_popcount(flags & (TRUN_SAMPLE_DURATION |
+                TRUN_SAMPLE_SIZE | TRUN_SAMPLE_FLAGS | TRUN_SAMPLE_CTO));
+    flags_field = 4 * __builtin_popcount(flags & (TRUN_SAMPLE_DURATION |
+                TRUN_SAMPLE_SIZE));
+
+    /*
+     * With per-sample flags every record is looked at; otherwise only the
+     * first sample may differ, and the remaining ones all share the default,
+     * so scanning stops once the keyframe positions kept are filled in, and
+     * the last sample is then the last sync one
+     */
+    for (sample = 0; sample < count; sample++, record += stride)
+    {
+        if (!per_sample && sample > 0 &&
+                (track->keyframe_count >= MAX_FRAGMENT_KEYFRAMES ||
+                 (defaults[DEFAULT_FLAGS] & SAMPLE_FLAG_NON_SYNC)))
+        {
+            if (defaults[DEFAULT_FLAGS] & SAMPLE_FLAG_NON_SYNC)
+                break;
+            track->keyframe_count += count - sample;
+            if (flags & TRUN_SAMPLE_DURATION)
+                for (; sample + 1 < count; sample++, record += stride)
+                    offset += box_get32(record);
+            else
+                offset += (uint64_t)(count - 1 - sample) *
+                    defaults[DEFAULT_DURATION];
+            track->last_keyframe.sample = track->sample_count + count - 1;
+            track->last_keyframe.offset = offset;
+            break;
+        }
+        if (per_sample)
+            sample_flag = box_get32(record + flags_field);
+        else if (sample == 0 && (flags & TRUN_FIRST_SAMPLE_FLAGS))
+            sample_flag = first_flags;
+        else
+            sample_flag = defaults[DEFAULT_FLAGS];
+        if (!(sample_flag & SAMPLE_FLAG_NON_SYNC))
+        {
+            if (track->keyframe_count < MAX_FRAGMENT_KEYFRAMES)
+            {
+                track->keyframes[track->keyframe_count].sample =
+                    track->sample_count + sample;
+                track->keyframes[track->keyframe_count].offset = offset;
+            }
+            track->last_keyframe.sample = track->sample_count + sample;
+            track->last_keyframe.offset = offset;
+            ++(track->keyframe_count);
+        }
+        offset += (flags & TRUN_SAMPLE_DURATION) ? box_get32(record) :
+            defaults[DEFAULT_DURATION];
+    }
+}
+
+#ifdef FRAGMENT_SSSE3
+__attribute__((target("ssse3")))
+static size_t
+fragment_sum_ssse3(const uint8_t *table,
+                   size_t         blocks,
+                   uint64_t       words[SAMPLE_BLOCK_WORDS])
+{
+    const __m128i swap   = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+                                        4, 5, 6, 7, 0, 1, 2, 3);
+    const __m128i zero   = _mm_setzero_si128();
+    __m128i       sum[6] = {};
+    __m128i       value  = zero;
+    size_t        block  = 0;
+    size_t        idx    = 0;
+
+    /* Byte-swap 4 words at a time, widening into 64-bit lanes */
+    for (block = 0; block < blocks; block++)
+    {
+        for (idx = 0; idx < 3; idx++)
+        {
+            value = _mm_loadu_si128((const __m128i *)(table +
+                        block * SAMPLE_BLOCK_SIZE + idx * 16));
+            value = _mm_shuffle_epi8(value, swap);
+            sum[idx * 2] = _mm_add_epi64(sum[idx * 2],
+                    _mm_unpacklo_epi32(value, zero));
+            sum[idx * 2 + 1] = _mm_add_epi64(sum[idx * 2 + 1],
+                    _mm_unpackhi_epi32(value, zero));
+        }
+    }
+
+    /* Lanes of accumulator pairs hold word positions 4i .. 4i + 3 */
+    for (idx = 0; idx < 3; idx++)
+    {
+        _mm_storeu_si128((__m128i *)(&(words[idx * 4])), sum[idx * 2]);
+        _mm_storeu_si128((__m128i *)(&(words[idx * 4 + 2])), sum[idx * 2 + 1]);
+    }
+
+    return blocks;
+}
+#endif
+
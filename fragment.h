@@ -0,0 +1,93 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   fragment.h
+ * Desc:   Movie fragment sample table summary header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <fmp4.h>
+
+#include "common.h"
+#include "error.h"
+#include "track.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Maximum distinct tracks summarized per fragment */
+    #define MAX_FRAGMENT_TRACKS 16
+
+    /* Track fragment header flags */
+    #define TFHD_BASE_DATA_OFFSET         0x000001
+    #define TFHD_SAMPLE_DESCRIPTION_INDEX 0x000002
+    #define TFHD_DEFAULT_SAMPLE_DURATION  0x000008
+    #define TFHD_DEFAULT_SAMPLE_SIZE      0x000010
+    #define TFHD_DEFAULT_SAMPLE_FLAGS     0x000020
+
+    /* Track run flags */
+    #define TRUN_DATA_OFFSET              0x000001
+    #define TRUN_FIRST_SAMPLE_FLAGS       0x000004
+    #define TRUN_SAMPLE_DURATION          0x000100
+    #define TRUN_SAMPLE_SIZE              0x000200
+    #define TRUN_SAMPLE_FLAGS             0x000400
+    #define TRUN_SAMPLE_CTO               0x000800
+
+    /* Maximum sync samples located per track of a fragment */
+    #define MAX_FRAGMENT_KEYFRAMES 8
+
+    /* Sample flags bit marking samples other samples depend on */
+    #define SAMPLE_FLAG_NON_SYNC 0x00010000
+
+    /* Sync sample position within its track fragment */
+    typedef struct fragment_keyframe_t
+    {
+        uint32_t sample; // index among samples of track in fragment
+        uint64_t offset; // decode time past decode_time, in timescale
+
+    } fragment_keyframe_t;
+
+    /* Per-track totals of all track runs of a fragment */
+    typedef struct fragment_track_t
+    {
+        uint32_t            track_id;
+        uint32_t            sample_count;
+        uint64_t            sample_bytes;
+        uint64_t            duration;        // sum of sample durations
+        uint64_t            decode_time;     // tfdt of first track fragment
+        bool                has_decode_time;
+        uint32_t            keyframe_count;  // all sync samples
+        fragment_keyframe_t keyframes[MAX_FRAGMENT_KEYFRAMES]; // first ones
+        fragment_keyframe_t last_keyframe;   // if any, past those kept too
+
+    } fragment_track_t;
+
+    /* Summary of one moof */
+    typedef struct fragment_t
+    {
+        uint32_t         sequence;
+        size_t           track_count;
+        fragment_track_t tracks[MAX_FRAGMENT_TRACKS];
+
+    } fragment_t;
+
+    /* Exported public functions */
+    bool fragment_parse(fragment_t *fragment, const fmp4_box_t *moof,
+            const track_table_t *tracks);
+    const fragment_track_t *fragment_track(const fragment_t *fragment,
+            uint32_t track_id);
+    void fragment_sum_samples(const uint8_t *table, size_t count,
+            size_t stride, uint64_t sums[4]);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,174 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   fragment_sequence.c
+ * Desc:   FMP4 fragment loss, duplication & reordering metric
+ */
+
+#include <fmp4.h>
+#include <inttypes.h>
+
+#include "error.h"
+#include "metric.h"
+
+/* Sequence numbers tracked behind highest, and largest gap still counted */
+#define SEQUENCE_WINDOW  64
+#define SEQUENCE_MAX_GAP 1024
+
+/* Internal metric context */
+typedef struct context_t
+{
+    uint64_t prev_time_ms;
+    uint32_t connection;  // window below belongs to
+    bool     started;
+    uint32_t highest;     // highest sequence number seen
+    uint64_t window;      // bit n set if highest - n was seen, or before
+    uint64_t lost;        // gaps left behind the window, within interval
+    uint64_t duplicated;
+    uint64_t reordered;   // late arrivals filling a gap in the window
+
+} context_t;
+
+static metric_context_t fragment_sequence_context(error_context_t *errctx);
+static bool fragment_sequence_emit(metric_context_t ctx, const fmp4_box_t *box,
+        error_context_t *errctx);
+static void fragment_sequence_track(context_t *ctx, uint32_t sequence);
+static void fragment_sequence_restart(context_t *ctx);
+
+static metric_t fragment_sequence =
+{
+    .envname = "FRAGMENT_SEQUENCE",
+    .masks   = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO,
+    .context = fragment_sequence_context,
+    .emit    = fragment_sequence_emit,
+};
+
+REGISTER_METRIC(fragment_sequence);
+
+static metric_context_t
+fragment_sequence_context(error_context_t *errctx)
+{
+    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    error_save_retval_if(!ctx, errctx, errno, NULL);
+    return (metric_context_t)(ctx);
+}
+
+static bool
+fragment_sequence_emit(metric_context_t  ctx,
+                       const fmp4_box_t  *box,
+                       error_context_t  *errctx)
+{
+    context_t             *metric_ctx = NULL;
+    const metric_stream_t *stream     = NULL;
+    uint64_t               now_ms     = 0;
+
+    /* Sanity checks */
+    if (!ctx || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast context to internal metric context */
+    metric_ctx = (context_t *)(ctx);
+
+    /* Sequence numbers come with fragment headers */
+    switch (ntohl(box->type))
+    {
+        case 0x6d6f6f66: break; // moof box
+        default: return true;
+    }
+
+    /* Each connection numbers its fragments anew */
+    stream = metrics_stream();
+    if (stream && metric_ctx->connection != stream->connection)
+    {
+        metric_ctx->connection = stream->connection;
+        fragment_sequence_restart(metric_ctx);
+    }
+    /*
+     * Fragments without a header sequence number carry no ordering, and
+     * ones sampled under overload leave gaps that are not loss
+     */
+    if (metrics_weight() > 1)
+        fragment_sequence_restart(metric_ctx);
+    else if (metrics_fragment()->sequence)
+        fragment_sequence_track(metric_ctx, metrics_fragment()->sequence);
+
+    /* Check if we are at the end of an interval time frame */
+    now_ms = metrics_now_ms();
+    if (metric_ctx->prev_time_ms == 0)
+        metric_ctx->prev_time_ms = now_ms;
+    if (now_ms - metric_ctx->prev_time_ms < fragment_sequence.interval_ms)
+        return true;
+
+    /* Output & reset interval counts */
+    if (!metric_output(&fragment_sequence, ".lost", metric_ctx->lost, 0,
+                now_ms, errctx))
+        return false;
+    if (!metric_output(&fragment_sequence, ".duplicated",
+                metric_ctx->duplicated, 0, now_ms, errctx))
+        return false;
+    if (!metric_output(&fragment_sequence, ".reordered", metric_ctx->reordered,
+                0, now_ms, errctx))
+        return false;
+    metric_ctx->lost = metric_ctx->duplicated = metric_ctx->reordered = 0;
+    metric_ctx->prev_time_ms = now_ms;
+
+    return true;
+}
+
+static void
+fragment_sequence_track(context_t *ctx,
+                        uint32_t   sequence)
+{
+    uint32_t ahead  = sequence - ctx->highest;
+    uint32_t behind = ctx->highest - sequence;
+
+    /* First fragment, or a jump too far to be loss, e.g. packager restart */
+    if (ctx->started && ahead > SEQUENCE_MAX_GAP && behind >= SEQUENCE_WINDOW)
+        fragment_sequence_restart(ctx);
+    if (!ctx->started)
+    {
+        ctx->highest = sequence;
+        ctx->window = ~0ULL;
+        ctx->started = true;
+        return;
+    }
+
+    /*
+     * Ahead: numbers skipped may still turn up late, they are lost once
+     * shifted out of the window unseen, or skipped past it altogether
+     */
+    if (ahead > 0 && ahead <= SEQUENCE_MAX_GAP)
+    {
+        if (ahead < SEQUENCE_WINDOW)
+        {
+            ctx->lost += ahead - __builtin_popcountll(ctx->window >>
+                    (SEQUENCE_WINDOW - ahead));
+            ctx->window = (ctx->window << ahead) | 1;
+        }
+        else
+        {
+            ctx->lost += SEQUENCE_WINDOW - __builtin_popcountll(ctx->window) +
+                ahead - SEQUENCE_WINDOW;
+            ctx->window = 1;
+        }
+        ctx->highest = sequence;
+        return;
+    }
+
+    /* Behind: seen before is a duplicate, otherwise fills an earlier gap */
+    if (ctx->window & (1ULL << behind))
+        ++(ctx->duplicated);
+    else
+    {
+        ++(ctx->reordered);
+        ctx->window |= 1ULL << behind;
+    }
+}
+
+static void fragment_sequence_restart(context_t *ctx)
+{
+    /* Gaps still open in the window will not be filled any more */
+    if (ctx->started)
+        ctx->lost += SEQUENCE_WINDOW - __builtin_popcountll(ctx->window);
+    ctx->started = false;
+}
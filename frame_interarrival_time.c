@@ -12,20 +12,41 @@
 #include "error.h"
 #include "metric.h"
 
+/* RFC 3550 jitter estimator gain */
+#define JITTER_GAIN (1.0 / 16.0)
+
+/* Per-track arrival statistics, O(1) whatever the interval */
+typedef struct arrival_t
+{
+    uint64_t count;             // interarrival times within interval
+    double   mean_ms;           // Welford running mean
+    double   m2;                // Welford sum of squared deviations
+    int64_t  prev_transit_ms;   // arrival less media time of last fragment
+    uint64_t prev_media_ms;
+    bool     has_transit;
+    double   jitter_ms;         // smoothed over stream, not reset per interval
+
+} arrival_t;
+
 /* Internal metric context */
 typedef struct context_t
 {
-    uint64_t prev_time_ms;
-    uint64_t prev_audio_ms;
-    uint64_t prev_video_ms;
-    uint64_t audio_max_interarrival_ms;
-    uint64_t video_max_interarrival_ms;
+    uint64_t  prev_time_ms;
+    uint32_t  generation;                  // of track table slots below
+    uint64_t  prev_track_ms[MAX_TRACKS];
+    uint64_t  max_interarrival_ms[MAX_TRACKS];
+    arrival_t arrivals[MAX_TRACKS];
 
 } context_t;
 
 static metric_context_t frame_interarrival_time_context(error_context_t *errctx);
 static bool frame_interarrival_time_emit(metric_context_t ctx,
         const fmp4_box_t *box, error_context_t *errctx);
+static void frame_interarrival_time_update(arrival_t *arrival,
+        const track_t *track, const fragment_track_t *traf, uint64_t diff_ms,
+        bool has_diff, uint64_t now_ms);
+static bool frame_interarrival_time_output(arrival_t *arrival,
+        const track_t *track, uint64_t now_ms, error_context_t *errctx);
 
 static metric_t frame_interarrival_time =
 {
@@ -50,12 +71,15 @@ frame_interarrival_time_emit(metric_context_t  ctx,
                              const fmp4_box_t  *box,
                              error_context_t  *errctx)
 {
-    context_t *metric_ctx    = NULL;
-    uint64_t   now_ms        = 0;
-    uint64_t   diff_ms       = 0;
-    uint64_t  *prev_media_ms = 0;
-    uint64_t  *media_max_ms  = 0;
-    int        ret           = -1;
+    context_t           *metric_ctx = NULL;
+    const track_table_t *tracks     = NULL;
+    const fragment_t    *fragment   = NULL;
+    char                 series[MAX_TRACK_SERIES_LEN + sizeof(".max")] = {0};
+    uint64_t             now_ms     = 0;
+    uint64_t             diff_ms    = 0;
+    bool                 has_diff   = false;
+    size_t               idx        = 0;
+    int                  slot       = -1;
 
     /* Sanity checks */
     if (!ctx || !box || !errctx)
@@ -71,56 +95,63 @@ frame_interarrival_time_emit(metric_context_t  ctx,
 	default: return true;
     }
 
-    /* move to moof child - mfhd box */
-    fmp4_box_t* curBox = (fmp4_box_t*)box->body;
-    /* move to mfhd sibling - traf box */
-    curBox = (fmp4_box_t*)( (uint8_t*)curBox + ntohl(curBox->size) );
-    /* move to traf child - tfhd */
-    curBox = (fmp4_box_t*)curBox->body;
-
-    /* check this track is video or audio */
-    fmp4_full_box_t* tfhd = (fmp4_full_box_t*)curBox;
-    uint32_t* track_id = (uint32_t*)tfhd->body;
-    if (ntohl(*track_id) == 1) { 
-        prev_media_ms = &(metric_ctx->prev_video_ms);
-	media_max_ms = &(metric_ctx->video_max_interarrival_ms);
-    } else if (ntohl(*track_id) == 2) { 
-        prev_media_ms = &(metric_ctx->prev_audio_ms);
-	media_max_ms = &(metric_ctx->audio_max_interarrival_ms);
-    }
-
-    /* Initialize tracking timestamps */
-    now_ms = current_time_milliseconds();
+    /* Initialize tracking timestamps, starting over on new tracks */
+    now_ms = metrics_now_ms();
     if (metric_ctx->prev_time_ms == 0)
         metric_ctx->prev_time_ms = now_ms;
+    tracks = metrics_tracks();
+    if (metric_ctx->generation != tracks->generation)
+    {
+        memset(metric_ctx->prev_track_ms, 0, sizeof(metric_ctx->prev_track_ms));
+        memset(metric_ctx->max_interarrival_ms, 0,
+                sizeof(metric_ctx->max_interarrival_ms));
+        memset(metric_ctx->arrivals, 0, sizeof(metric_ctx->arrivals));
+        metric_ctx->generation = tracks->generation;
+    }
 
-    /* Update minimum & maximum interarrival times */
-    if (*prev_media_ms == 0) *prev_media_ms = now_ms;
-    if (*prev_media_ms > now_ms) return true; // redundant
-    diff_ms = now_ms - *prev_media_ms;
-    *media_max_ms = MAX(*media_max_ms, diff_ms);
-    *prev_media_ms = now_ms;
+    /* Update interarrival statistics of every track in fragment */
+    fragment = metrics_fragment();
+    for (idx = 0; idx < fragment->track_count; idx++)
+    {
+        slot = track_table_slot(tracks, fragment->tracks[idx].track_id);
+        if (slot < 0)
+            continue;
+        /* Fragments sampled under overload are not adjacent, none to measure */
+        if (metrics_weight() > 1)
+            metric_ctx->prev_track_ms[slot] = 0;
+        has_diff = metric_ctx->prev_track_ms[slot] != 0;
+        if (metric_ctx->prev_track_ms[slot] == 0)
+            metric_ctx->prev_track_ms[slot] = now_ms;
+        if (metric_ctx->prev_track_ms[slot] > now_ms)
+            continue;
+        diff_ms = now_ms - metric_ctx->prev_track_ms[slot];
+        metric_ctx->max_interarrival_ms[slot] = MAX(
+                metric_ctx->max_interarrival_ms[slot], diff_ms);
+        metric_ctx->prev_track_ms[slot] = now_ms;
+        frame_interarrival_time_update(&(metric_ctx->arrivals[slot]),
+                &(tracks->tracks[slot]), &(fragment->tracks[idx]), diff_ms,
+                has_diff, now_ms);
+    }
 
     /* Check if we are at the end of an interval time frame */
     diff_ms = now_ms - metric_ctx->prev_time_ms;
     if (diff_ms <= 0) return true;
     if (diff_ms >= frame_interarrival_time.interval_ms)
     {
-        /* Output audio minimum & maximum interarrival times */
-        ret = printf("%s.audio.max %" PRIu64 " %" PRIu64 "\n",
-                frame_interarrival_time.path,
-                metric_ctx->audio_max_interarrival_ms,
-                now_ms / 1000);
-        error_save_retval_if(ret < 0, errctx, errno, false);
-        metric_ctx->audio_max_interarrival_ms = 0;
-
-        /* Output video minimum & maximum interarrival times */
-        ret = printf("%s.video.max %" PRIu64 " %" PRIu64 "\n",
-                frame_interarrival_time.path,
-                metric_ctx->video_max_interarrival_ms,
-                now_ms / 1000);
-        error_save_retval_if(ret < 0, errctx, errno, false);
-        metric_ctx->video_max_interarrival_ms = 0;
+        /* Output maximum interarrival time of each track measured within */
+        for (idx = 0; idx < tracks->count; idx++)
+        {
+            (void)snprintf(series, sizeof(series), "%s.max",
+                    tracks->tracks[idx].series);
+            if (metric_ctx->arrivals[idx].count && !metric_output(
+                        &frame_interarrival_time, series,
+                        metric_ctx->max_interarrival_ms[idx], 0, now_ms, errctx))
+                return false;
+            metric_ctx->max_interarrival_ms[idx] = 0;
+            if (!frame_interarrival_time_output(&(metric_ctx->arrivals[idx]),
+                        &(tracks->tracks[idx]), now_ms, errctx))
+                return false;
+        }
 
         /* Reset previous time */
         metric_ctx->prev_time_ms = now_ms;
@@ -129,4 +160,74 @@ frame_interarrival_time_emit(metric_context_t  ctx,
     return true;
 }
 
+static void
+frame_interarrival_time_update(arrival_t              *arrival,
+                               const track_t          *track,
+                               const fragment_track_t *traf,
+                               uint64_t                diff_ms,
+                               bool                    has_diff,
+                               uint64_t                now_ms)
+{
+    uint64_t media_ms   = 0;
+    int64_t  transit_ms = 0;
+    double   delta      = 0;
+
+    /* Welford update of interarrival mean & squared deviations */
+    if (has_diff)
+    {
+        ++(arrival->count);
+        delta = (double)(diff_ms) - arrival->mean_ms;
+        arrival->mean_ms += delta / (double)(arrival->count);
+        arrival->m2 += delta * ((double)(diff_ms) - arrival->mean_ms);
+    }
+
+    /* Jitter needs media time, a timeline jumping back starts over */
+    if (!traf->has_decode_time || !track->timescale)
+        return;
+    media_ms = track_to_ms(track, traf->decode_time);
+    transit_ms = (int64_t)(now_ms) - (int64_t)(media_ms);
+    if (arrival->has_transit && media_ms >= arrival->prev_media_ms)
+    {
+        /* RFC 3550 section 6.4.1: J += (|D(i-1,i)| - J) / 16 */
+        delta = fabs((double)(transit_ms - arrival->prev_transit_ms));
+        arrival->jitter_ms += (delta - arrival->jitter_ms) * JITTER_GAIN;
+    }
+    arrival->prev_transit_ms = transit_ms;
+    arrival->prev_media_ms = media_ms;
+    arrival->has_transit = true;
+}
+
+static bool
+frame_interarrival_time_output(arrival_t       *arrival,
+                               const track_t   *track,
+                               uint64_t         now_ms,
+                               error_context_t *errctx)
+{
+    char   series[MAX_TRACK_SERIES_LEN + sizeof(".stddev")] = {0};
+    double stddev_ms                                     = 0;
+
+    /* Sample standard deviation of interarrival times within interval */
+    if (arrival->count > 1)
+        stddev_ms = sqrt(arrival->m2 / (double)(arrival->count - 1));
+
+    /* Output interarrival mean & deviation if any were measured, & jitter */
+    (void)snprintf(series, sizeof(series), "%s.mean", track->series);
+    if (arrival->count && !metric_output(&frame_interarrival_time, series,
+                arrival->mean_ms, 1, now_ms, errctx))
+        return false;
+    (void)snprintf(series, sizeof(series), "%s.stddev", track->series);
+    if (arrival->count && !metric_output(&frame_interarrival_time, series,
+                stddev_ms, 1, now_ms, errctx))
+        return false;
+    (void)snprintf(series, sizeof(series), "%s.jitter", track->series);
+    if (!metric_output(&frame_interarrival_time, series, arrival->jitter_ms, 1,
+                now_ms, errctx))
+        return false;
+
+    /* Reset interval aggregates, jitter carries on */
+    arrival->count = 0;
+    arrival->mean_ms = arrival->m2 = 0;
+
+    return true;
+}
 
@@ -16,29 +16,48 @@ typedef struct context_t
 {
     uint64_t init_time_ms;
     uint64_t prev_time_ms;
-    size_t   audio_frames;
-    size_t   video_frames;
+    uint32_t generation;          // of track table frames are counted for
+    uint64_t frames[MAX_TRACKS];  // per track table slot
+    window_t windows[];           // per slot, window_count each
 
 } context_t;
 
+static bool frames_per_second_configure(const char *options,
+        error_context_t *errctx);
 static metric_context_t frames_per_second_context(error_context_t *errctx);
 static bool frames_per_second_emit(metric_context_t ctx, const fmp4_box_t *box,
         error_context_t *errctx);
 
 static metric_t frames_per_second =
 {
-    .envname = "FRAMES_PER_SECOND",
-    .masks   = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO,
-    .context = frames_per_second_context,
-    .emit    = frames_per_second_emit,
+    .envname   = "FRAMES_PER_SECOND",
+    .masks     = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO,
+    .context   = frames_per_second_context,
+    .emit      = frames_per_second_emit,
+    .configure = frames_per_second_configure,
 };
 
 REGISTER_METRIC(frames_per_second);
 
+/* Extra sliding & EWMA windows, same for every stream */
+static window_spec_t window_specs[MAX_WINDOWS] = {};
+static size_t        window_count              = 0;
+
+static bool
+frames_per_second_configure(const char      *options,
+                            error_context_t *errctx)
+{
+    window_count = window_parse(options, window_specs, MAX_WINDOWS, errctx);
+    return window_count != SIZE_MAX;
+}
+
 static metric_context_t
 frames_per_second_context(error_context_t *errctx)
 {
-    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    context_t *ctx = NULL;
+
+    ctx = (context_t *)(calloc(1, sizeof(context_t) +
+                MAX_TRACKS * window_count * sizeof(window_t)));
     error_save_retval_if(!ctx, errctx, errno, NULL);
     return (metric_context_t)(ctx);
 }
@@ -48,12 +67,16 @@ frames_per_second_emit(metric_context_t  ctx,
                        const fmp4_box_t  *box,
                        error_context_t  *errctx)
 {
-    context_t *metric_ctx = NULL;
-    uint64_t   now_ms     = 0;
-    uint64_t   diff_ms    = 0;
-    float      audio_fps  = 0;
-    float      video_fps  = 0;
-    int        ret        = -1;
+    context_t           *metric_ctx = NULL;
+    const track_table_t *tracks     = NULL;
+    const fragment_t    *fragment   = NULL;
+    uint64_t             now_ms     = 0;
+    uint64_t             diff_ms    = 0;
+    uint64_t             count      = 0;
+    float                fps        = 0;
+    size_t               idx        = 0;
+    size_t               widx       = 0;
+    int                  slot       = -1;
 
     /* Sanity checks */
     if (!ctx || !box || !errctx)
@@ -69,49 +92,63 @@ frames_per_second_emit(metric_context_t  ctx,
 	default: return true;
     }
 
-    /* move to moof child - mfhd box */
-    fmp4_box_t* curBox = (fmp4_box_t*)box->body;
-    //fprintf(stderr, "-mfhd SIZE: %d, TYPE: %u\n", ntohl(curBox->size), curBox->type);
-    /* move to mfhd sibling - traf box */
-    curBox = (fmp4_box_t*)( (uint8_t*)curBox + ntohl(curBox->size) );
-    //fprintf(stderr, "-traf SIZE: %d, TYPE: %u\n", ntohl(curBox->size), curBox->type);
-    /* move to traf child - tfhd */
-    curBox = (fmp4_box_t*)curBox->body;
-    //fprintf(stderr, "-tfhd SIZE: %d, TYPE: %u\n", ntohl(curBox->size), curBox->type);
-
-    /* check this track is video or audio */
-    fmp4_full_box_t* tfhd = (fmp4_full_box_t*)curBox;
-    uint32_t* track_id = (uint32_t*)tfhd->body;
-    if (ntohl(*track_id) == 1) { ++(metric_ctx->video_frames);
-    } else { ++(metric_ctx->audio_frames);  }
+    /* Count samples of every track run, starting over on new tracks */
+    tracks = metrics_tracks();
+    if (metric_ctx->generation != tracks->generation)
+    {
+        memset(metric_ctx->frames, 0, sizeof(metric_ctx->frames));
+        for (idx = 0; idx < MAX_TRACKS * window_count; idx++)
+            window_init(&(metric_ctx->windows[idx]),
+                    &(window_specs[idx % window_count]));
+        metric_ctx->generation = tracks->generation;
+    }
+    now_ms = metrics_now_ms();
+    fragment = metrics_fragment();
+    for (idx = 0; idx < fragment->track_count; idx++)
+    {
+        slot = track_table_slot(tracks, fragment->tracks[idx].track_id);
+        if (slot < 0)
+            continue;
+
+        /* Sampled fragments count for the ones left out too */
+        count = fragment->tracks[idx].sample_count * metrics_weight();
+        metric_ctx->frames[slot] += count;
+        for (widx = 0; widx < window_count; widx++)
+            window_add(&(metric_ctx->windows[slot * window_count + widx]),
+                    now_ms, count);
+    }
 
     /* Initialize tracking timestamps */
-    now_ms = current_time_milliseconds();
     if (metric_ctx->init_time_ms == 0)
         metric_ctx->init_time_ms = metric_ctx->prev_time_ms = now_ms;
 
-    /* Check if we're still within warmup period */
+    /* Check if we're still within warmup period, first interval starts after */
     if (now_ms - metric_ctx->init_time_ms < frames_per_second.interval_ms)
+    {
+        memset(metric_ctx->frames, 0, sizeof(metric_ctx->frames));
+        metric_ctx->prev_time_ms = now_ms;
         return true;
+    }
 
     /* Check if we are at the end of an interval time frame */
     diff_ms = now_ms - metric_ctx->prev_time_ms;
     if (diff_ms <= 0) return true;
     if (diff_ms >= frames_per_second.interval_ms)
     {
-        /* Calculate audio FPS */
-        audio_fps = (float)(metric_ctx->audio_frames) * 1000 / (float)(diff_ms);
-        ret = printf("%s.audio %.2f %" PRIu64 "\n",
-                frames_per_second.path, audio_fps, now_ms / 1000);
-        error_save_retval_if(ret < 0, errctx, errno, false);
-        metric_ctx->audio_frames = 0;
-
-        /* Calculate video FPS */
-        video_fps = (float)(metric_ctx->video_frames) * 1000 / (float)(diff_ms);
-        ret = printf("%s.video %.2f %" PRIu64 "\n",
-                frames_per_second.path, video_fps, now_ms / 1000);
-        error_save_retval_if(ret < 0, errctx, errno, false);
-        metric_ctx->video_frames = 0;
+        /* Calculate FPS of each track */
+        for (idx = 0; idx < tracks->count; idx++)
+        {
+            fps = (float)(metric_ctx->frames[idx]) * 1000 / (float)(diff_ms);
+            if (!metric_output(&frames_per_second, tracks->tracks[idx].series,
+                        fps, 2, now_ms, errctx))
+                return false;
+            if (!metric_output_windows(&frames_per_second,
+                        tracks->tracks[idx].series,
+                        &(metric_ctx->windows[idx * window_count]),
+                        window_count, true, 1, 2, now_ms, errctx))
+                return false;
+            metric_ctx->frames[idx] = 0;
+        }
 
         /* Reset previous time */
         metric_ctx->prev_time_ms = now_ms;
@@ -0,0 +1,322 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   history.c
+ * Desc:   In-memory recent metric history & local query socket implementation
+ */
+
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "history.h"
+
+/* Decimals of fixed-point values at most, & query wait for a stop flag */
+#define HISTORY_MAX_PRECISION 6
+#define HISTORY_POLL_MS       1000
+
+/* Point layout, lap of ring the point was recorded in & fixed-point value */
+#define HISTORY_VALUE_BITS    40
+#define HISTORY_VALUE_MAX     ((1LL << (HISTORY_VALUE_BITS - 1)) - 1)
+#define HISTORY_VALUE_MASK    ((1ULL << HISTORY_VALUE_BITS) - 1)
+#define HISTORY_LAP_MASK      ((1ULL << (64 - HISTORY_VALUE_BITS)) - 1)
+
+/* Series of a stream, claimed by the first value recorded for it */
+typedef struct history_series_t
+{
+    uint64_t key;        // path hash mixed with stream id, 0 if unclaimed
+    bool     ready;      // names below are set
+    uint8_t  precision;  // decimals of fixed-point values
+    char     stream[HISTORY_STREAM_LEN];
+    char     series[HISTORY_SERIES_LEN];
+
+} history_series_t;
+
+/*
+ * Series & a ring of points per series, indexed by second; a point packs
+ * the lap of its second & its fixed-point value into one word so that
+ * recording it is one store & queries never see half of it
+ */
+static struct
+{
+    history_series_t *series;
+    uint64_t         *points;    // lap << 40 | 40-bit value, per series
+    size_t            capacity;  // series
+    size_t            seconds;   // points per series
+    char              path[sizeof(((struct sockaddr_un *)(0))->sun_path)];
+    int               listen_fd;
+    pthread_t         thread;
+    volatile bool     run;
+    bool              started;
+
+} history = { .listen_fd = -1 };
+
+/* Fixed-point scale per number of decimals */
+static const double scales[HISTORY_MAX_PRECISION + 1] =
+{
+    1, 10, 100, 1000, 10000, 100000, 1000000
+};
+
+static void *history_server(void *arg);
+static void history_query(int fd);
+static uint64_t history_lap(uint64_t time_s);
+
+bool history_init(error_context_t *errctx)
+{
+    const char         *config   = NULL;
+    const char         *comma    = NULL;
+    char               *end      = NULL;
+    struct sockaddr_un  address  = {};
+    sigset_t            blocked  = {};
+    sigset_t            previous = {};
+    int                 ret      = -1;
+    bool                result   = false;
+
+    /* History is optional */
+    config = getenv(METRIC_HISTORY_ENVNAME);
+    if (!config)
+        return true;
+
+    /* Extract configuration values */
+    comma = strchr(config, ',');
+    error_save_jump_if(!comma, errctx, EINVAL, CLEANUP);
+    ret = snprintf(address.sun_path, sizeof(address.sun_path), "%.*s",
+            (int)(comma - config), config);
+    error_save_jump_if(ret <= 0 || ret >= sizeof(address.sun_path), errctx,
+            EINVAL, CLEANUP);
+    history.seconds = strtoull(comma + 1, &end, 10);
+    history.capacity = HISTORY_SERIES;
+    if (*end == ',')
+        history.capacity = strtoull(end + 1, NULL, 10);
+    error_save_jump_if(history.seconds == 0 ||
+            history.seconds > HISTORY_MAX_SECONDS || history.capacity == 0 ||
+            history.capacity > UINT32_MAX, errctx, EINVAL, CLEANUP);
+
+    /* Rings stay without backing memory until series record into them */
+    history.series = (history_series_t *)(calloc(history.capacity,
+                sizeof(history_series_t)));
+    history.points = (uint64_t *)(calloc(history.capacity * history.seconds,
+                sizeof(uint64_t)));
+    error_save_jump_if(!history.series || !history.points, errctx, errno,
+            CLEANUP);
+
+    /* Listen on socket, replacing one left over by a previous run */
+    address.sun_family = AF_UNIX;
+    (void)unlink(address.sun_path);
+    history.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    error_save_jump_if(history.listen_fd < 0, errctx, errno, CLEANUP);
+    ret = bind(history.listen_fd, (struct sockaddr *)(&address),
+            sizeof(address));
+    error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+    NULL_TERM_STRNCPY(history.path, address.sun_path, sizeof(history.path));
+    ret = listen(history.listen_fd, SOMAXCONN);
+    error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+
+    /* Server leaves termination signals to the main thread */
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    (void)pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    history.run = true;
+    ret = pthread_create(&(history.thread), NULL, history_server, NULL);
+    (void)pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    error_save_jump_if(ret != 0, errctx, ret, CLEANUP);
+    history.started = true;
+
+    result = true;
+
+CLEANUP:
+
+    if (!result)
+        history_fini();
+
+    return result;
+}
+
+void
+history_record(uint64_t    key,
+               const char *stream,
+               const char *series,
+               double      value,
+               int         precision,
+               uint64_t    now_ms)
+{
+    history_series_t *slot     = NULL;
+    uint64_t          expected = 0;
+    uint64_t          time_s   = now_ms / 1000;
+    uint64_t          point    = 0;
+    double            scaled   = 0;
+    size_t            probe    = 0;
+    size_t            idx      = 0;
+
+    /* Nothing to do if history is disabled */
+    if (!history.series || !series)
+        return;
+
+    /* Find series, or claim the first free one on its probe path */
+    key = key ? key : 1;
+    precision = MIN(MAX(precision, 0), HISTORY_MAX_PRECISION);
+    for (probe = 0; probe < HISTORY_MAX_PROBES; probe++)
+    {
+        idx = (key + probe) % history.capacity;
+        slot = &(history.series[idx]);
+        expected = __atomic_load_n(&(slot->key), __ATOMIC_ACQUIRE);
+        if (expected == key)
+            break;
+        if (expected == 0 && __atomic_compare_exchange_n(&(slot->key),
+                    &expected, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            /* Name claimed series before queries may see it */
+            NULL_TERM_STRNCPY(slot->stream, stream ? stream : "-",
+                    sizeof(slot->stream));
+            NULL_TERM_STRNCPY(slot->series, series, sizeof(slot->series));
+            slot->precision = precision;
+            __atomic_store_n(&(slot->ready), true, __ATOMIC_RELEASE);
+            break;
+        }
+        if (expected == key)
+            break;
+    }
+    if (unlikely(probe == HISTORY_MAX_PROBES))
+        return; // table crowded, series not kept
+
+    /* Record fixed-point value in slot of its second, saturating */
+    scaled = round(value * scales[precision]);
+    if (isnan(scaled))
+        scaled = 0;
+    scaled = MAX(MIN(scaled, HISTORY_VALUE_MAX), -HISTORY_VALUE_MAX);
+    point = (history_lap(time_s) << HISTORY_VALUE_BITS) |
+        ((uint64_t)((int64_t)(scaled)) & HISTORY_VALUE_MASK);
+    __atomic_store_n(&(history.points[idx * history.seconds +
+                time_s % history.seconds]), point, __ATOMIC_RELAXED);
+}
+
+void history_fini(void)
+{
+    /* Stop server, interrupting its wait for clients */
+    if (history.started)
+    {
+        history.run = false;
+        (void)pthread_kill(history.thread, SIGUSR1);
+        (void)pthread_join(history.thread, NULL);
+        history.started = false;
+    }
+
+    /* Remove socket & release history */
+    if (history.listen_fd >= 0)
+        close(history.listen_fd);
+    history.listen_fd = -1;
+    if (history.path[0])
+        (void)unlink(history.path);
+    history.path[0] = '\0';
+    FREE_AND_NULLIFY(history.series);
+    FREE_AND_NULLIFY(history.points);
+}
+
+static void *history_server(void *arg)
+{
+    struct pollfd listener = { .fd = history.listen_fd, .events = POLLIN };
+    int           fd       = -1;
+
+    while (history.run)
+    {
+        /* Wait for a client, a wake-up signal interrupts the wait */
+        if (poll(&listener, 1, HISTORY_POLL_MS) <= 0)
+            continue;
+        fd = accept(history.listen_fd, NULL, NULL);
+        if (fd >= 0)
+            history_query(fd);
+    }
+
+    return NULL;
+}
+
+static void history_query(int fd)
+{
+    struct timeval          timeout                        = { .tv_sec = 1 };
+    char                    query[HISTORY_QUERY_LEN + 1]   = {0};
+    char                    streams[HISTORY_QUERY_LEN + 1] = {0};
+    char                    series[HISTORY_QUERY_LEN + 1]  = {0};
+    const history_series_t *slot                           = NULL;
+    FILE                   *file                           = NULL;
+    long long               from                           = 0;
+    long long               to                             = 0;
+    long long               now_s                          = 0;
+    long long               time_s                         = 0;
+    uint64_t                point                          = 0;
+    size_t                  length                         = 0;
+    size_t                  idx                            = 0;
+    ssize_t                 ret                            = -1;
+
+    /* Queries are served one at a time, slow clients are cut short */
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    (void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    file = fdopen(fd, "w");
+    if (!file)
+    {
+        close(fd);
+        return;
+    }
+
+    /* Read query line */
+    while (length < HISTORY_QUERY_LEN && !memchr(query, '\n', length))
+    {
+        ret = read(fd, query + length, HISTORY_QUERY_LEN - length);
+        if (ret <= 0)
+            break;
+        length += ret;
+    }
+
+    /* Parse query, last seconds of history by default */
+    now_s = current_time_milliseconds() / 1000;
+    from = -(long long)(history.seconds);
+    to = 0;
+    if (sscanf(query, "%" STRINGIFY(HISTORY_QUERY_LEN) "s %"
+                STRINGIFY(HISTORY_QUERY_LEN) "s %lld %lld", streams, series,
+                &from, &to) < 2)
+    {
+        fprintf(file, "error invalid query\n");
+        FCLOSE_AND_NULLIFY(file);
+        return;
+    }
+    from = from > 0 ? from : now_s + from;
+    to = to > 0 ? to : now_s + to;
+    from = MAX(MAX(from, to - (long long)(history.seconds) + 1), 1);
+
+    /* Output points of matching series within range */
+    for (idx = 0; idx < history.capacity; idx++)
+    {
+        slot = &(history.series[idx]);
+        if (!__atomic_load_n(&(slot->ready), __ATOMIC_ACQUIRE) ||
+                fnmatch(streams, slot->stream, 0) != 0 ||
+                fnmatch(series, slot->series, 0) != 0)
+            continue;
+        for (time_s = from; time_s <= to; time_s++)
+        {
+            point = __atomic_load_n(&(history.points[idx * history.seconds +
+                        time_s % history.seconds]), __ATOMIC_RELAXED);
+            if ((point >> HISTORY_VALUE_BITS) != history_lap(time_s))
+                continue;
+            fprintf(file, "%s %s %.*f %lld\n", slot->stream, slot->series,
+                    slot->precision, (double)((int64_t)(point <<
+                            (64 - HISTORY_VALUE_BITS)) >>
+                        (64 - HISTORY_VALUE_BITS)) / scales[slot->precision],
+                    time_s);
+        }
+    }
+
+    FCLOSE_AND_NULLIFY(file);
+}
+
+static uint64_t history_lap(uint64_t time_s)
+{
+    /* Never 0, which marks empty points; wraps after 2^24 laps, 194 days+ */
+    return (time_s / history.seconds) % HISTORY_LAP_MASK + 1;
+}
+
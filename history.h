@@ -0,0 +1,53 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   history.h
+ * Desc:   In-memory recent metric history & local query socket header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Environment variable holding "<socket path>,<seconds>[,<series>]" */
+    #define METRIC_HISTORY_ENVNAME "METRIC_HISTORY"
+
+    /* Limits of history kept, a point per series & second */
+    #define HISTORY_MAX_SECONDS    (24 * 3600)
+    #define HISTORY_SERIES         4096
+    #define HISTORY_MAX_PROBES     16
+
+    /* Maximum lengths of names kept per series & of query lines */
+    #define HISTORY_STREAM_LEN     64
+    #define HISTORY_SERIES_LEN     128
+    #define HISTORY_QUERY_LEN      512
+
+    /*
+     * Query socket protocol, one query per connection:
+     *   "<stream glob> <series glob> [<from s> [<to s>]]\n"
+     * times are UNIX seconds, or relative to now if not positive, e.g. "-60 0";
+     * answered by "<stream> <series> <value> <time s>\n" lines, streams
+     * without name match as "-", after which the connection is closed
+     */
+
+    /* Exported public functions */
+    bool history_init(error_context_t *errctx);
+    void history_record(uint64_t key, const char *stream, const char *series,
+            double value, int precision, uint64_t now_ms);
+    void history_fini(void);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,354 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   hop_latency.c
+ * Desc:   FMP4 stream per-hop latency metric across delivery tiers
+ */
+
+#include <fmp4.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "error.h"
+#include "metric.h"
+
+/* Groups & tiers correlated, fragments remembered per tier & awaiting match */
+#define MAX_HOP_GROUPS   32
+#define MAX_HOP_TIERS    4
+#define HOP_MATCH_SLOTS  256  // power of 2
+#define HOP_PENDING      32
+#define HOP_READ_RETRIES 4
+
+/* Seqlock-protected arrival of a fragment, sequence odd while updating */
+typedef struct match_t
+{
+    uint32_t sequence;
+    uint32_t reserved;
+    uint64_t key;         // track & decode time or mfhd sequence, 0 if free
+    uint64_t arrival_ms;
+
+} match_t;
+
+/*
+ * Arrivals of one stream at every tier, each tier written by its own worker
+ * only & read by the worker of the tier below it; newer fragments overwrite
+ * older ones sharing a slot, bounding the window fragments are matched in
+ */
+typedef struct hop_group_t
+{
+    uint64_t id;          // zero if group is unclaimed
+    uint32_t users;       // contexts of tiers using table, guarded by lock
+    uint32_t weights[MAX_HOP_TIERS]; // of last fragment, > 1 while sampled
+    match_t  tiers[MAX_HOP_TIERS][HOP_MATCH_SLOTS];
+
+} hop_group_t;
+
+/* Own arrival whose upstream arrival is not known yet */
+typedef struct pending_t
+{
+    uint64_t key;         // 0 if matched or free
+    uint64_t arrival_ms;
+
+} pending_t;
+
+/* Internal metric context */
+typedef struct context_t
+{
+    uint64_t     prev_time_ms;
+    hop_group_t *group;                 // claimed on first fragment
+    pending_t    pending[HOP_PENDING];
+    size_t       next;                  // pending entry overwritten next
+    uint64_t     matched;               // within interval
+    uint64_t     unmatched;
+    double       min_ms;
+    double       max_ms;
+    double       mean_ms;               // Welford running mean
+    double       m2;                    // Welford sum of squared deviations
+
+} context_t;
+
+static metric_context_t hop_latency_context(error_context_t *errctx);
+static bool hop_latency_emit(metric_context_t ctx, const fmp4_box_t *box,
+        error_context_t *errctx);
+static void hop_latency_release(metric_context_t ctx);
+static hop_group_t *hop_latency_group(uint64_t id);
+static uint64_t hop_latency_key(const fragment_t *fragment);
+static void hop_latency_publish(match_t *tier, uint64_t key,
+        uint64_t arrival_ms);
+static bool hop_latency_lookup(const match_t *tier, uint64_t key,
+        uint64_t *arrival_ms);
+static void hop_latency_update(context_t *ctx, double hop_ms);
+
+static metric_t hop_latency =
+{
+    .envname = "HOP_LATENCY",
+    .masks   = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO,
+    .context = hop_latency_context,
+    .emit    = hop_latency_emit,
+    .release = hop_latency_release,
+};
+
+REGISTER_METRIC(hop_latency);
+
+/*
+ * Match tables shared by the workers of all grouped streams, claimed on a
+ * tier's first fragment & freed with the context of its last tier
+ */
+static hop_group_t     groups[MAX_HOP_GROUPS] = {};
+static pthread_mutex_t groups_lock            = PTHREAD_MUTEX_INITIALIZER;
+
+static metric_context_t
+hop_latency_context(error_context_t *errctx)
+{
+    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    error_save_retval_if(!ctx, errctx, errno, NULL);
+    return (metric_context_t)(ctx);
+}
+
+static bool
+hop_latency_emit(metric_context_t  ctx,
+                 const fmp4_box_t  *box,
+                 error_context_t  *errctx)
+{
+    context_t             *metric_ctx = NULL;
+    const metric_stream_t *stream     = NULL;
+    pending_t             *pending    = NULL;
+    uint64_t               now_ms     = 0;
+    uint64_t               key        = 0;
+    uint64_t               upstream   = 0;
+    size_t                 idx        = 0;
+
+    /* Sanity checks */
+    if (!ctx || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast context to internal metric context */
+    metric_ctx = (context_t *)(ctx);
+
+    /* Fragments are matched across tiers */
+    switch (ntohl(box->type))
+    {
+        case 0x6d6f6f66: break; // moof box
+        default: return true;
+    }
+
+    /* Only grouped streams are correlated, beyond the last tier is not */
+    stream = metrics_stream();
+    if (!stream || !stream->group || stream->group_kind != METRIC_GROUP_TIERS ||
+            stream->tier >= MAX_HOP_TIERS)
+        return true;
+    if (!metric_ctx->group)
+        metric_ctx->group = hop_latency_group(stream->group);
+    if (!metric_ctx->group)
+        return true; // too many groups
+    key = hop_latency_key(metrics_fragment());
+    if (!key)
+        return true;
+
+    /* Publish arrival for the tier below */
+    now_ms = metrics_now_ms();
+    hop_latency_publish(metric_ctx->group->tiers[stream->tier], key, now_ms);
+    __atomic_store_n(&(metric_ctx->group->weights[stream->tier]),
+            metrics_weight(), __ATOMIC_RELAXED);
+
+    /*
+     * Match own arrivals against tier above, including earlier ones; a tier
+     * sampled under overload leaves most fragments out, which are not lost
+     */
+    if (stream->tier > 0)
+    {
+        pending = &(metric_ctx->pending[metric_ctx->next]);
+        if (pending->key && __atomic_load_n(
+                    &(metric_ctx->group->weights[stream->tier - 1]),
+                    __ATOMIC_RELAXED) <= 1)
+            ++(metric_ctx->unmatched);
+        pending->key = key;
+        pending->arrival_ms = now_ms;
+        metric_ctx->next = (metric_ctx->next + 1) % HOP_PENDING;
+        for (idx = 0; idx < HOP_PENDING; idx++)
+        {
+            pending = &(metric_ctx->pending[idx]);
+            if (pending->key && hop_latency_lookup(
+                        metric_ctx->group->tiers[stream->tier - 1],
+                        pending->key, &upstream))
+            {
+                hop_latency_update(metric_ctx,
+                        (double)(pending->arrival_ms) - (double)(upstream));
+                pending->key = 0;
+            }
+        }
+    }
+
+    /* Check if we are at the end of an interval time frame */
+    if (metric_ctx->prev_time_ms == 0)
+        metric_ctx->prev_time_ms = now_ms;
+    if (now_ms - metric_ctx->prev_time_ms < hop_latency.interval_ms)
+        return true;
+    metric_ctx->prev_time_ms = now_ms;
+    if (stream->tier == 0)
+        return true;
+
+    /* Output hop latency distribution & fragments matched within interval */
+    if (!metric_output(&hop_latency, ".min", metric_ctx->min_ms, 0, now_ms,
+                errctx))
+        return false;
+    if (!metric_output(&hop_latency, ".mean", metric_ctx->mean_ms, 1, now_ms,
+                errctx))
+        return false;
+    if (!metric_output(&hop_latency, ".max", metric_ctx->max_ms, 0, now_ms,
+                errctx))
+        return false;
+    if (!metric_output(&hop_latency, ".stddev", metric_ctx->matched > 1 ?
+                sqrt(metric_ctx->m2 / (metric_ctx->matched - 1)) : 0, 1,
+                now_ms, errctx))
+        return false;
+    if (!metric_output(&hop_latency, ".matched", metric_ctx->matched, 0,
+                now_ms, errctx))
+        return false;
+    if (!metric_output(&hop_latency, ".unmatched", metric_ctx->unmatched, 0,
+                now_ms, errctx))
+        return false;
+
+    /* Reset interval aggregates, pending arrivals carry over */
+    metric_ctx->matched = metric_ctx->unmatched = 0;
+    metric_ctx->min_ms = metric_ctx->max_ms = 0;
+    metric_ctx->mean_ms = metric_ctx->m2 = 0;
+
+    return true;
+}
+
+static void hop_latency_release(metric_context_t ctx)
+{
+    context_t *metric_ctx = (context_t *)(ctx);
+
+    /* Free group's table once no tier uses it, stale arrivals included */
+    if (!metric_ctx->group)
+        return;
+    (void)pthread_mutex_lock(&groups_lock);
+    if (--(metric_ctx->group->users) == 0)
+        memset(metric_ctx->group, 0, sizeof(hop_group_t));
+    (void)pthread_mutex_unlock(&groups_lock);
+    metric_ctx->group = NULL;
+}
+
+static hop_group_t *hop_latency_group(uint64_t id)
+{
+    hop_group_t *group  = NULL;
+    hop_group_t *unused = NULL;
+    size_t       probe  = 0;
+
+    /*
+     * Find group's table, or claim the first free one on its probe path;
+     * rare enough to lock, which keeps users counted with claims
+     */
+    (void)pthread_mutex_lock(&groups_lock);
+    for (probe = 0; probe < MAX_HOP_GROUPS; probe++)
+    {
+        group = &(groups[(id + probe) % MAX_HOP_GROUPS]);
+        if (group->id == id)
+            break;
+        if (group->id == 0 && !unused)
+            unused = group;
+        group = NULL;
+    }
+    if (!group && unused)
+    {
+        group = unused;
+        group->id = id;
+    }
+    if (group)
+        ++(group->users);
+    (void)pthread_mutex_unlock(&groups_lock);
+
+    return group;
+}
+
+static uint64_t hop_latency_key(const fragment_t *fragment)
+{
+    const fragment_track_t *traf = NULL;
+    uint64_t                key  = 0;
+
+    /*
+     * Tiers pass fragments on unchanged, so the first track's decode time
+     * identifies a fragment; mfhd sequence numbers only without one
+     */
+    if (fragment->track_count == 0)
+        return 0;
+    traf = &(fragment->tracks[0]);
+    if (traf->has_decode_time)
+        key = traf->decode_time ^ ((uint64_t)(traf->track_id) << 48);
+    else if (fragment->sequence)
+        key = (1ULL << 63) | fragment->sequence;
+    else
+        return 0;
+
+    /* SplitMix64 finalizer spreads consecutive fragments over slots */
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+
+    return key ? key : 1;
+}
+
+static void
+hop_latency_publish(match_t  *tier,
+                    uint64_t  key,
+                    uint64_t  arrival_ms)
+{
+    match_t  *slot     = &(tier[key & (HOP_MATCH_SLOTS - 1)]);
+    uint32_t  sequence = __atomic_load_n(&(slot->sequence), __ATOMIC_RELAXED);
+
+    /* Single writer per tier, making sequence odd needs no exchange */
+    __atomic_store_n(&(slot->sequence), sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->key = key;
+    slot->arrival_ms = arrival_ms;
+    __atomic_store_n(&(slot->sequence), sequence + 2, __ATOMIC_RELEASE);
+}
+
+static bool
+hop_latency_lookup(const match_t *tier,
+                   uint64_t       key,
+                   uint64_t      *arrival_ms)
+{
+    const match_t *slot  = &(tier[key & (HOP_MATCH_SLOTS - 1)]);
+    match_t        copy  = {};
+    uint32_t       begin = 0;
+    size_t         tries = 0;
+
+    /* Copy slot until no writer interfered with the copy */
+    for (tries = 0; tries < HOP_READ_RETRIES; tries++)
+    {
+        begin = __atomic_load_n(&(slot->sequence), __ATOMIC_ACQUIRE);
+        if (begin & 1)
+            continue;
+        copy.key = slot->key;
+        copy.arrival_ms = slot->arrival_ms;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (begin != __atomic_load_n(&(slot->sequence), __ATOMIC_RELAXED))
+            continue;
+        if (copy.key != key)
+            return false;
+        *arrival_ms = copy.arrival_ms;
+        return true;
+    }
+
+    return false;
+}
+
+static void hop_latency_update(context_t *ctx, double hop_ms)
+{
+    double delta = 0;
+
+    /* Downstream may be faster than upstream connection, hops can be < 0 */
+    ctx->min_ms = ctx->matched ? MIN(ctx->min_ms, hop_ms) : hop_ms;
+    ctx->max_ms = ctx->matched ? MAX(ctx->max_ms, hop_ms) : hop_ms;
+    ++(ctx->matched);
+    delta = hop_ms - ctx->mean_ms;
+    ctx->mean_ms += delta / ctx->matched;
+    ctx->m2 += delta * (hop_ms - ctx->mean_ms);
+}
+
@@ -0,0 +1,241 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   keyframe_cadence.c
+ * Desc:   FMP4 stream keyframe interval & GOP duration metric
+ */
+
+#include <fmp4.h>
+#include <inttypes.h>
+
+#include "error.h"
+#include "metric.h"
+
+/* Per-track GOP state & interval aggregates */
+typedef struct gop_t
+{
+    uint64_t samples;             // samples seen, indexes keyframes
+    uint64_t last_key_ms;         // media time of last keyframe
+    uint64_t last_key_sample;
+    uint64_t last_end_ms;         // media time past last fragment
+    bool     has_key;
+    uint32_t keyframes;
+    uint32_t intervals;
+    uint64_t interval_ms_sum;
+    uint64_t interval_frames_sum;
+    uint64_t max_gop_ms;
+
+} gop_t;
+
+/* Internal metric context */
+typedef struct context_t
+{
+    uint64_t prev_time_ms;
+    uint32_t generation;          // of track table slots below
+    gop_t    gops[MAX_TRACKS];
+
+} context_t;
+
+static metric_context_t keyframe_cadence_context(error_context_t *errctx);
+static bool keyframe_cadence_emit(metric_context_t ctx, const fmp4_box_t *box,
+        error_context_t *errctx);
+static void keyframe_cadence_track(gop_t *gop, const track_t *track,
+        const fragment_track_t *traf);
+static bool keyframe_cadence_output(gop_t *gop, const track_t *track,
+        uint64_t now_ms, error_context_t *errctx);
+
+static metric_t keyframe_cadence =
+{
+    .envname = "KEYFRAME_CADENCE",
+    .masks   = METRIC_MASK_VIDEO,
+    .context = keyframe_cadence_context,
+    .emit    = keyframe_cadence_emit,
+};
+
+REGISTER_METRIC(keyframe_cadence);
+
+static metric_context_t
+keyframe_cadence_context(error_context_t *errctx)
+{
+    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    error_save_retval_if(!ctx, errctx, errno, NULL);
+    return (metric_context_t)(ctx);
+}
+
+static bool
+keyframe_cadence_emit(metric_context_t  ctx,
+                      const fmp4_box_t  *box,
+                      error_context_t  *errctx)
+{
+    context_t           *metric_ctx = NULL;
+    const track_table_t *tracks     = NULL;
+    const fragment_t    *fragment   = NULL;
+    uint64_t             now_ms     = 0;
+    size_t               idx        = 0;
+    int                  slot       = -1;
+
+    /* Sanity checks */
+    if (!ctx || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast context to internal metric context */
+    metric_ctx = (context_t *)(ctx);
+
+    /* Sample flags come with fragments */
+    switch (ntohl(box->type))
+    {
+        case 0x6d6f6f66: break; // moof box
+        default: return true;
+    }
+
+    /* Initialize tracking timestamps, starting over on new tracks */
+    now_ms = metrics_now_ms();
+    if (metric_ctx->prev_time_ms == 0)
+        metric_ctx->prev_time_ms = now_ms;
+    tracks = metrics_tracks();
+    if (metric_ctx->generation != tracks->generation)
+    {
+        memset(metric_ctx->gops, 0, sizeof(metric_ctx->gops));
+        metric_ctx->generation = tracks->generation;
+    }
+
+    /* Follow keyframes of video tracks */
+    fragment = metrics_fragment();
+    for (idx = 0; idx < fragment->track_count; idx++)
+    {
+        slot = track_table_slot(tracks, fragment->tracks[idx].track_id);
+        if (slot >= 0 && tracks->tracks[slot].handler == TRACK_HANDLER_VIDEO)
+            keyframe_cadence_track(&(metric_ctx->gops[slot]),
+                    &(tracks->tracks[slot]), &(fragment->tracks[idx]));
+    }
+
+    /* Check if we are at the end of an interval time frame */
+    if (now_ms - metric_ctx->prev_time_ms < keyframe_cadence.interval_ms)
+        return true;
+    for (idx = 0; idx < tracks->count; idx++)
+    {
+        if (tracks->tracks[idx].handler == TRACK_HANDLER_VIDEO &&
+                !keyframe_cadence_output(&(metric_ctx->gops[idx]),
+                    &(tracks->tracks[idx]), now_ms, errctx))
+            return false;
+    }
+    metric_ctx->prev_time_ms = now_ms;
+
+    return true;
+}
+
+static void
+keyframe_cadence_track(gop_t                  *gop,
+                       const track_t          *track,
+                       const fragment_track_t *traf)
+{
+    const fragment_keyframe_t *keyframe = NULL;
+    uint64_t                   key_ms   = 0;
+    uint64_t                   sample   = 0;
+    uint32_t                   tail     = 0;
+    size_t                     idx      = 0;
+
+    /* Keyframe times need decode time & timescale */
+    if (!traf->has_decode_time || !track->timescale)
+        return;
+
+    /*
+     * A timeline jumping back leaves no previous keyframe to measure from,
+     * nor do fragments sampled under overload, which are not adjacent
+     */
+    if (track_to_ms(track, traf->decode_time) < gop->last_end_ms ||
+            metrics_weight() > 1)
+        gop->has_key = false;
+
+    /* Intervals between located keyframes, in media time & samples */
+    for (idx = 0; idx < MIN(traf->keyframe_count, MAX_FRAGMENT_KEYFRAMES); idx++)
+    {
+        keyframe = &(traf->keyframes[idx]);
+        key_ms = track_to_ms(track, traf->decode_time + keyframe->offset);
+        sample = gop->samples + keyframe->sample;
+        if (gop->has_key && key_ms >= gop->last_key_ms)
+        {
+            gop->interval_ms_sum += key_ms - gop->last_key_ms;
+            gop->interval_frames_sum += sample - gop->last_key_sample;
+            gop->max_gop_ms = MAX(gop->max_gop_ms, key_ms - gop->last_key_ms);
+            ++(gop->intervals);
+        }
+        gop->last_key_ms = key_ms;
+        gop->last_key_sample = sample;
+        gop->has_key = true;
+    }
+
+    /*
+     * Sync samples past those located, e.g. all-intra video, count at their
+     * average spacing up to the last one, which next intervals start from
+     */
+    if (traf->keyframe_count > MAX_FRAGMENT_KEYFRAMES)
+    {
+        tail = traf->keyframe_count - MAX_FRAGMENT_KEYFRAMES;
+        key_ms = track_to_ms(track, traf->decode_time +
+                traf->last_keyframe.offset);
+        sample = gop->samples + traf->last_keyframe.sample;
+        if (key_ms >= gop->last_key_ms)
+        {
+            gop->interval_ms_sum += key_ms - gop->last_key_ms;
+            gop->interval_frames_sum += sample - gop->last_key_sample;
+            gop->max_gop_ms = MAX(gop->max_gop_ms,
+                    (key_ms - gop->last_key_ms) / tail);
+            gop->intervals += tail;
+        }
+        gop->last_key_ms = key_ms;
+        gop->last_key_sample = sample;
+    }
+    gop->keyframes += traf->keyframe_count * metrics_weight();
+    gop->samples += traf->sample_count * metrics_weight();
+
+    /* A GOP still open counts for its length so far */
+    gop->last_end_ms = track_to_ms(track, traf->decode_time + traf->duration);
+    if (gop->has_key && gop->last_end_ms >= gop->last_key_ms)
+        gop->max_gop_ms = MAX(gop->max_gop_ms,
+                gop->last_end_ms - gop->last_key_ms);
+}
+
+static bool
+keyframe_cadence_output(gop_t           *gop,
+                        const track_t   *track,
+                        uint64_t         now_ms,
+                        error_context_t *errctx)
+{
+    char   series[MAX_TRACK_SERIES_LEN + sizeof(".interval_frames")] = {0};
+    double interval_ms                                            = 0;
+    double interval_frames                                        = 0;
+
+    /* Averages over keyframe intervals completed within interval */
+    if (gop->intervals)
+    {
+        interval_ms = (double)(gop->interval_ms_sum) / gop->intervals;
+        interval_frames = (double)(gop->interval_frames_sum) / gop->intervals;
+    }
+
+    /* Output keyframe count, average interval if any ended & longest GOP */
+    (void)snprintf(series, sizeof(series), "%s.keyframes", track->series);
+    if (!metric_output(&keyframe_cadence, series, gop->keyframes, 0, now_ms,
+                errctx))
+        return false;
+    (void)snprintf(series, sizeof(series), "%s.interval_ms", track->series);
+    if (gop->intervals && !metric_output(&keyframe_cadence, series,
+                interval_ms, 0, now_ms, errctx))
+        return false;
+    (void)snprintf(series, sizeof(series), "%s.interval_frames", track->series);
+    if (gop->intervals && !metric_output(&keyframe_cadence, series,
+                interval_frames, 1, now_ms, errctx))
+        return false;
+    (void)snprintf(series, sizeof(series), "%s.max_gop_ms", track->series);
+    if (!metric_output(&keyframe_cadence, series, gop->max_gop_ms, 0, now_ms,
+                errctx))
+        return false;
+
+    /* Reset interval aggregates, keeping the GOP in progress */
+    gop->keyframes = gop->intervals = 0;
+    gop->interval_ms_sum = gop->interval_frames_sum = 0;
+    gop->max_gop_ms = 0;
+
+    return true;
+}
+
@@ -0,0 +1,412 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   ladder_alignment.c
+ * Desc:   FMP4 stream rendition ladder alignment metric
+ */
+
+#include <fmp4.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "error.h"
+#include "metric.h"
+
+/* Ladders & renditions compared, media times remembered per rendition */
+#define MAX_LADDER_GROUPS     32
+#define MAX_LADDER_RENDITIONS 8
+#define LADDER_EVENTS         16
+#define LADDER_READ_RETRIES   4
+
+/* Alignment checks, indexing series & interval aggregates */
+typedef enum check_t
+{
+    CHECK_FRAGMENT,
+    CHECK_KEYFRAME,
+    CHECK_EGWC,
+    CHECK_COUNT,
+
+} check_t;
+
+static const char *check_series[CHECK_COUNT] =
+{
+    ".fragment_ms", ".keyframe_ms", ".egwc_ms",
+};
+
+/* Timeline of a rendition, in ms of media time, as far as received */
+typedef struct rendition_t
+{
+    uint32_t sequence;                    // odd while worker updates it
+    uint32_t reserved;
+    uint64_t fragments;                   // boundaries recorded
+    uint64_t keyframes;
+    int64_t  boundaries_ms[LADDER_EVENTS]; // fragment starts, ring
+    int64_t  keyframes_ms[LADDER_EVENTS];
+    int64_t  end_ms;                      // past last fragment received
+    int64_t  offset_ms;                   // egwc wallclock less media time
+    bool     has_offset;
+
+} rendition_t;
+
+/*
+ * Renditions of one channel, each written by its own worker only & read
+ * by the workers of the other renditions
+ */
+typedef struct ladder_t
+{
+    uint64_t    id;                       // zero if ladder is unclaimed
+    uint32_t    users;                    // contexts of renditions, locked
+    rendition_t renditions[MAX_LADDER_RENDITIONS];
+
+} ladder_t;
+
+/* Internal metric context */
+typedef struct context_t
+{
+    uint64_t     prev_time_ms;
+    ladder_t    *ladder;                  // claimed on first fragment
+    rendition_t *shared;                  // own timeline within ladder
+    rendition_t  own;                     // published whole per fragment
+    uint64_t     wallclock_ms;            // of egwc awaiting its fragment
+    uint64_t     compared[CHECK_COUNT];   // within interval
+    int64_t      max_ms[CHECK_COUNT];
+
+} context_t;
+
+static metric_context_t ladder_alignment_context(error_context_t *errctx);
+static bool ladder_alignment_emit(metric_context_t ctx, const fmp4_box_t *box,
+        error_context_t *errctx);
+static void ladder_alignment_release(metric_context_t ctx);
+static ladder_t *ladder_alignment_group(uint64_t id);
+static bool ladder_alignment_record(context_t *ctx);
+static void ladder_alignment_publish(context_t *ctx);
+static void ladder_alignment_compare(context_t *ctx, const rendition_t *other,
+        const fragment_track_t *traf, const track_t *track);
+static int64_t ladder_alignment_nearest(const int64_t *ring, uint64_t count,
+        int64_t time_ms, int64_t *oldest_ms);
+static void ladder_alignment_update(context_t *ctx, check_t check,
+        int64_t misalignment_ms);
+
+static metric_t ladder_alignment =
+{
+    .envname = "LADDER_ALIGNMENT",
+    .masks   = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO | METRIC_MASK_TIME,
+    .context = ladder_alignment_context,
+    .emit    = ladder_alignment_emit,
+    .release = ladder_alignment_release,
+};
+
+REGISTER_METRIC(ladder_alignment);
+
+/*
+ * Timelines shared by the workers of all ladders, claimed on a rendition's
+ * first fragment & freed with the context of its last rendition
+ */
+static ladder_t        ladders[MAX_LADDER_GROUPS] = {};
+static pthread_mutex_t ladders_lock               = PTHREAD_MUTEX_INITIALIZER;
+
+static metric_context_t
+ladder_alignment_context(error_context_t *errctx)
+{
+    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    error_save_retval_if(!ctx, errctx, errno, NULL);
+    return (metric_context_t)(ctx);
+}
+
+static bool
+ladder_alignment_emit(metric_context_t  ctx,
+                      const fmp4_box_t  *box,
+                      error_context_t  *errctx)
+{
+    context_t             *metric_ctx = NULL;
+    const metric_stream_t *stream     = NULL;
+    uint64_t               now_ms     = 0;
+    size_t                 idx        = 0;
+
+    /* Sanity checks */
+    if (!ctx || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast context to internal metric context */
+    metric_ctx = (context_t *)(ctx);
+
+    /* Only grouped streams are renditions of a ladder */
+    stream = metrics_stream();
+    if (!stream || !stream->group ||
+            stream->group_kind != METRIC_GROUP_LADDER ||
+            stream->tier >= MAX_LADDER_RENDITIONS)
+        return true;
+
+    /* Wallclock stamps the fragment that follows it */
+    switch (ntohl(box->type))
+    {
+        case 0x6d6f6f66: break; // moof box
+        case 0x65677763: // egwc box
+            metric_ctx->wallclock_ms = fmp4_parse_wallclock(box->body,
+                    ntohl(box->size), errctx) / 1000;
+            errctx->saved = false;
+            return true;
+        default: return true;
+    }
+
+    /* Publish timeline of fragment & compare it against other renditions */
+    if (!metric_ctx->ladder)
+        metric_ctx->ladder = ladder_alignment_group(stream->group);
+    if (!metric_ctx->ladder)
+        return true; // too many ladders
+    metric_ctx->shared = &(metric_ctx->ladder->renditions[stream->tier]);
+    if (!ladder_alignment_record(metric_ctx))
+        return true;
+
+    /* Check if we are at the end of an interval time frame */
+    now_ms = metrics_now_ms();
+    if (metric_ctx->prev_time_ms == 0)
+        metric_ctx->prev_time_ms = now_ms;
+    if (now_ms - metric_ctx->prev_time_ms < ladder_alignment.interval_ms)
+        return true;
+    metric_ctx->prev_time_ms = now_ms;
+
+    /* Output worst misalignment of checks made within interval */
+    for (idx = 0; idx < CHECK_COUNT; idx++)
+    {
+        if (metric_ctx->compared[idx] && !metric_output(&ladder_alignment,
+                    check_series[idx], metric_ctx->max_ms[idx], 0, now_ms,
+                    errctx))
+            return false;
+        metric_ctx->compared[idx] = 0;
+        metric_ctx->max_ms[idx] = 0;
+    }
+
+    return true;
+}
+
+static void ladder_alignment_release(metric_context_t ctx)
+{
+    context_t *metric_ctx = (context_t *)(ctx);
+
+    /* Nothing to give back before the first fragment */
+    if (!metric_ctx->ladder)
+        return;
+
+    /* Others stop comparing against a timeline no longer received */
+    if (metric_ctx->shared)
+    {
+        memset(&(metric_ctx->own), 0, sizeof(rendition_t));
+        ladder_alignment_publish(metric_ctx);
+    }
+
+    /* Free ladder's timelines once no rendition uses them */
+    (void)pthread_mutex_lock(&ladders_lock);
+    if (--(metric_ctx->ladder->users) == 0)
+        memset(metric_ctx->ladder, 0, sizeof(ladder_t));
+    (void)pthread_mutex_unlock(&ladders_lock);
+    metric_ctx->ladder = NULL;
+    metric_ctx->shared = NULL;
+}
+
+static ladder_t *ladder_alignment_group(uint64_t id)
+{
+    ladder_t *ladder = NULL;
+    ladder_t *unused = NULL;
+    size_t    probe  = 0;
+
+    /*
+     * Find ladder's timelines, or claim the first free ones on probe path;
+     * rare enough to lock, which keeps users counted with claims
+     */
+    (void)pthread_mutex_lock(&ladders_lock);
+    for (probe = 0; probe < MAX_LADDER_GROUPS; probe++)
+    {
+        ladder = &(ladders[(id + probe) % MAX_LADDER_GROUPS]);
+        if (ladder->id == id)
+            break;
+        if (ladder->id == 0 && !unused)
+            unused = ladder;
+        ladder = NULL;
+    }
+    if (!ladder && unused)
+    {
+        ladder = unused;
+        ladder->id = id;
+    }
+    if (ladder)
+        ++(ladder->users);
+    (void)pthread_mutex_unlock(&ladders_lock);
+
+    return ladder;
+}
+
+static bool ladder_alignment_record(context_t *ctx)
+{
+    const metric_stream_t  *stream   = metrics_stream();
+    const track_table_t    *tracks   = metrics_tracks();
+    const fragment_t       *fragment = metrics_fragment();
+    const fragment_track_t *traf     = NULL;
+    const track_t          *track    = NULL;
+    rendition_t            *shared   = NULL;
+    rendition_t             other    = {};
+    uint32_t                sequence = 0;
+    size_t                  idx      = 0;
+    size_t                  tries    = 0;
+    int                     slot     = -1;
+
+    /* Renditions align on video, audio-only ones on their first track */
+    for (idx = 0; idx < fragment->track_count; idx++)
+    {
+        slot = track_table_slot(tracks, fragment->tracks[idx].track_id);
+        if (slot < 0 || !fragment->tracks[idx].has_decode_time ||
+                !tracks->tracks[slot].timescale)
+            continue;
+        if (!traf || tracks->tracks[slot].handler == TRACK_HANDLER_VIDEO)
+        {
+            traf = &(fragment->tracks[idx]);
+            track = &(tracks->tracks[slot]);
+        }
+        if (track->handler == TRACK_HANDLER_VIDEO)
+            break;
+    }
+    if (!traf)
+        return false;
+
+    /*
+     * Extend own timeline by fragment, starting over after fragments left
+     * out under overload so that others never measure against their gap
+     */
+    if (metrics_weight() > 1)
+        ctx->own.fragments = ctx->own.keyframes = 0;
+    ctx->own.boundaries_ms[ctx->own.fragments++ % LADDER_EVENTS] =
+        (int64_t)(track_to_ms(track, traf->decode_time));
+    for (idx = 0; track->handler == TRACK_HANDLER_VIDEO &&
+            idx < MIN(traf->keyframe_count, MAX_FRAGMENT_KEYFRAMES); idx++)
+        ctx->own.keyframes_ms[ctx->own.keyframes++ % LADDER_EVENTS] =
+            (int64_t)(track_to_ms(track, traf->decode_time +
+                        traf->keyframes[idx].offset));
+    ctx->own.end_ms = (int64_t)(track_to_ms(track, traf->decode_time +
+                traf->duration));
+    if (ctx->wallclock_ms)
+    {
+        ctx->own.offset_ms = (int64_t)(ctx->wallclock_ms) -
+            (int64_t)(track_to_ms(track, traf->decode_time));
+        ctx->own.has_offset = true;
+        ctx->wallclock_ms = 0;
+    }
+
+    /* Publish it, then compare with a copy of every other rendition received */
+    ladder_alignment_publish(ctx);
+    for (idx = 0; idx < MAX_LADDER_RENDITIONS; idx++)
+    {
+        if (idx == stream->tier)
+            continue;
+        shared = &(ctx->ladder->renditions[idx]);
+        for (tries = 0; tries < LADDER_READ_RETRIES; tries++)
+        {
+            sequence = __atomic_load_n(&(shared->sequence), __ATOMIC_ACQUIRE);
+            if (sequence == 0)
+                break; // never published
+            if (sequence & 1)
+                continue;
+            memcpy(&other, shared, sizeof(other));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (sequence != __atomic_load_n(&(shared->sequence),
+                        __ATOMIC_RELAXED))
+                continue;
+            ladder_alignment_compare(ctx, &other, traf, track);
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void ladder_alignment_publish(context_t *ctx)
+{
+    rendition_t *shared   = ctx->shared;
+    uint32_t     sequence = __atomic_load_n(&(shared->sequence),
+            __ATOMIC_RELAXED);
+
+    /* Single writer per rendition, making sequence odd needs no exchange */
+    __atomic_store_n(&(shared->sequence), sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((uint8_t *)(shared) + sizeof(uint64_t),
+            (const uint8_t *)(&(ctx->own)) + sizeof(uint64_t),
+            sizeof(rendition_t) - sizeof(uint64_t));
+    __atomic_store_n(&(shared->sequence), sequence + 2, __ATOMIC_RELEASE);
+}
+
+static void
+ladder_alignment_compare(context_t              *ctx,
+                         const rendition_t      *other,
+                         const fragment_track_t *traf,
+                         const track_t          *track)
+{
+    int64_t start_ms   = (int64_t)(track_to_ms(track, traf->decode_time));
+    int64_t key_ms     = 0;
+    int64_t nearest_ms = 0;
+    int64_t oldest_ms  = 0;
+    size_t  idx        = 0;
+
+    /*
+     * Fragment start against boundaries of other rendition, whose next
+     * boundary is where its timeline ends; judged once it got that far
+     */
+    if (other->fragments && other->end_ms >= start_ms)
+    {
+        nearest_ms = MIN(ladder_alignment_nearest(other->boundaries_ms,
+                    other->fragments, start_ms, &oldest_ms),
+                other->end_ms - start_ms);
+        if (oldest_ms <= start_ms)
+            ladder_alignment_update(ctx, CHECK_FRAGMENT, nearest_ms);
+    }
+
+    /* Keyframes, unless a nearer one may lie beyond what it received */
+    for (idx = 0; other->keyframes && track->handler == TRACK_HANDLER_VIDEO &&
+            idx < MIN(traf->keyframe_count, MAX_FRAGMENT_KEYFRAMES); idx++)
+    {
+        key_ms = (int64_t)(track_to_ms(track, traf->decode_time +
+                    traf->keyframes[idx].offset));
+        nearest_ms = ladder_alignment_nearest(other->keyframes_ms,
+                other->keyframes, key_ms, &oldest_ms);
+        if (oldest_ms <= key_ms && other->end_ms >= key_ms + nearest_ms)
+            ladder_alignment_update(ctx, CHECK_KEYFRAME, nearest_ms);
+    }
+
+    /* Wallclock to media time mapping */
+    if (ctx->own.has_offset && other->has_offset)
+        ladder_alignment_update(ctx, CHECK_EGWC,
+                ctx->own.offset_ms > other->offset_ms ?
+                ctx->own.offset_ms - other->offset_ms :
+                other->offset_ms - ctx->own.offset_ms);
+}
+
+static int64_t
+ladder_alignment_nearest(const int64_t *ring,
+                         uint64_t       count,
+                         int64_t        time_ms,
+                         int64_t       *oldest_ms)
+{
+    int64_t nearest_ms = INT64_MAX;
+    int64_t diff_ms    = 0;
+    size_t  idx        = 0;
+
+    /* Distance to nearest time in ring & earliest time it still holds */
+    *oldest_ms = INT64_MAX;
+    for (idx = 0; idx < MIN(count, LADDER_EVENTS); idx++)
+    {
+        diff_ms = ring[idx] > time_ms ? ring[idx] - time_ms :
+            time_ms - ring[idx];
+        nearest_ms = MIN(nearest_ms, diff_ms);
+        *oldest_ms = MIN(*oldest_ms, ring[idx]);
+    }
+
+    return nearest_ms;
+}
+
+static void
+ladder_alignment_update(context_t *ctx,
+                        check_t    check,
+                        int64_t    misalignment_ms)
+{
+    ctx->max_ms[check] = MAX(ctx->max_ms[check], misalignment_ms);
+    ++(ctx->compared[check]);
+}
+
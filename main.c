@@ -18,46 +18,68 @@
 
 #include <fmp4.h>
 
+#include "batch.h"
+#include "capture.h"
+#include "cluster.h"
 #include "error.h"
+#include "history.h"
 #include "metric.h"
+#include "metric_table.h"
+#include "overload.h"
+#include "sink.h"
+#include "stream.h"
 #include "transport.h"
 
-#define STREAM_TIMEOUT_MS     (60 * 1000)
-#define RECONNECT_INTERVAL_MS (3000)
 #define GRAFANA_TIMEOUT_SECS  (15)
+#define MAIN_TICK_MS          (1000)
 
-/* Statistics Context */
-typedef struct context_t {
-    /* List of metrics contexts */
-    metric_context_t *metric_contexts;
-
-    /* Timestamps to track stream timeout */
-    uint64_t last_callback_ms;
-
-} context_t;
+/* Command line options */
+typedef struct options_t
+{
+    const char *url;
+    const char *sink;
+    const char *streams;
+    const char *members;
+    const char *self;
+    double      load_factor;
+    bool        print;
+    const char *capture;
+    bool        header_only;
+    const char *replay;
+    double      speed;
+    char *const *recordings;
+    size_t      recording_count;
+    size_t      jobs;
+    uint64_t    split_bytes;
+
+} options_t;
 
 static void usage(const char *command);
+static bool parse_options(int argc, char *argv[], options_t *options);
 static void signal_handler(int signum);
 static bool grafana_connect(const char *sink, error_context_t *errctx);
-static bool on_fmp4_box(const fmp4_box_t *box, void *userdata,
-        error_context_t *errctx);
-static bool timeout(const context_t *ctx);
+static bool rebalance(const cluster_t *cluster, stream_list_t *list,
+        bool print, error_context_t *errctx);
 
 /* Global variables & flags */
 bool run = true;
 
 int main(int argc, char *argv[])
 {
-    const char      *url    = NULL;
-    const char      *sink   = NULL;
-    fmp4_t          fmp4    = NULL;
-    context_t       _ctx    = {};
-    context_t       *ctx    = &_ctx;
-    error_context_t _errctx = {};
-    error_context_t *errctx = &_errctx;
-    bool             result = false;
-
-    if (argc != 3)
+    options_t        options  = {};
+    stream_list_t    list     = {};
+    cluster_t        cluster  = {};
+    cluster_t       *members  = NULL;
+    char             hostname[MAX_MEMBER_NAME_LEN + 1] = {0};
+    uint64_t         retry_ms = 0;
+    bool             sink_up  = false;
+    bool             assigned = false;
+    error_context_t _errctx   = {};
+    error_context_t *errctx   = &_errctx;
+    bool             result   = false;
+
+    /* Setup arguments */
+    if (!parse_options(argc, argv, &options))
     {
         usage(argv[0]);
         return EXIT_FAILURE;
@@ -66,55 +88,126 @@ int main(int argc, char *argv[])
     /* Setup signal handlers */
     signal(SIGPIPE, SIG_IGN);
     signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    if (!stream_init(errctx))
+        error_save_jump(errctx, errno, CLEANUP);
 
-    /* Setup arguments */
-    url = argv[1];
-    sink = argv[2];
+    /* Analyse recordings offline instead of receiving streams if requested */
+    if (options.recordings)
+    {
+        if (!grafana_connect(options.sink, errctx))
+            error_save_jump(errctx, errno, CLEANUP);
+        result = batch_run(options.recordings, options.recording_count,
+                options.jobs, options.split_bytes, &run, errctx);
+        goto CLEANUP;
+    }
+
+    /* Setup streams, either one unnamed stream or a named list */
+    if (options.streams)
+    {
+        if (!stream_list_load(&list, options.streams, errctx))
+            error_save_jump(errctx, errno, CLEANUP);
+    }
+    else if (!options.replay && !stream_list_add(&list, NULL, options.url, NULL,
+                errctx))
+        error_save_jump(errctx, errno, CLEANUP);
 
-    /* Initialize metrics */
-    if (!metrics_init(&(ctx->metric_contexts), errctx))
+    /* Capture received boxes if requested */
+    if (options.capture && !stream_list_capture(&list, options.capture,
+                options.header_only, errctx))
+        error_save_jump(errctx, errno, CLEANUP);
+
+    /* Setup cluster membership, member name defaults to host name */
+    if (options.members)
+    {
+        if (!options.self)
+        {
+            error_save_jump_if(gethostname(hostname, sizeof(hostname) - 1) < 0,
+                    errctx, errno, CLEANUP);
+            options.self = hostname;
+        }
+        cluster.path = options.members;
+        cluster.self = options.self;
+        cluster.load_factor = options.load_factor;
+        if (!cluster_load(&cluster, errctx))
+            error_save_jump(errctx, errno, CLEANUP);
+        members = &cluster;
+    }
+
+    /* Only output streams this daemon would take if requested */
+    if (options.print)
+    {
+        result = rebalance(members, &list, true, errctx);
+        goto CLEANUP;
+    }
+
+    /* Setup shared-memory metric table, sink outage spool & history */
+    if (!metric_table_init(errctx))
+        error_save_jump(errctx, errno, CLEANUP);
+    if (!sink_init(errctx))
+        error_save_jump(errctx, errno, CLEANUP);
+    if (!history_init(errctx))
+        error_save_jump(errctx, errno, CLEANUP);
+
+    /* Replay captured boxes instead of receiving streams if requested */
+    if (options.replay)
+    {
+        if (!grafana_connect(options.sink, errctx))
+            error_save_jump(errctx, errno, CLEANUP);
+        result = capture_replay(options.replay, options.speed, &run, errctx);
+        goto CLEANUP;
+    }
+
+    /* Watch streams for stalls & daemon for overload, whatever streams do */
+    if (!overload_init(errctx))
+        error_save_jump(errctx, errno, CLEANUP);
+    if (!stream_watchdog_start(&list, errctx))
         error_save_jump(errctx, errno, CLEANUP);
 
     /* Main loop entry here */
     while (run)
     {
-        do
+        /* Connect to Grafana daemon, again once output to it fails */
+        if (metrics_output_failed)
+            sink_up = false;
+        if (!sink_up && current_time_milliseconds() >= retry_ms)
         {
-            /* Connect to Grafana daemon */
-            if (!grafana_connect(sink, errctx))
-                error_save_break(errctx, errno);
-
-            /* Setup FMP4 stream context */
-            fmp4 = fmp4_create(url, errctx);
-            error_save_break_if(!fmp4, errctx, errno);
-
-            /* Connect to FMP4 stream source */
-            if (!fmp4_connect(fmp4, errctx))
-                error_save_break(errctx, errno);
-
-            /* Receive media frames for analysis & debug */
-            ctx->last_callback_ms = current_time_milliseconds();
-            while (run && fmp4_recv(fmp4, on_fmp4_box, ctx, errctx))
-                error_save_break_if(timeout(ctx), errctx, ENODATA);
+            sink_up = grafana_connect(options.sink, errctx);
+            if (sink_up)
+            {
+                clearerr(stdout);
+                metrics_output_failed = false;
+            }
+            retry_ms = current_time_milliseconds() + RECONNECT_INTERVAL_MS;
+            error_log_saved(errctx);
         }
-        while (false);
 
-        /* Output log if error occurred */
-        error_log_saved(errctx);
+        /* Backfill lines spooled during outages, paced beside live output */
+        sink_backfill(current_time_milliseconds());
 
-        /* Release acquired resources */
-        fmp4_destroy(&fmp4);
+        /* Start owned streams, rebalancing whenever membership changes */
+        if (!assigned || (members && cluster_changed(members)))
+        {
+            if ((!assigned || cluster_load(members, errctx)) &&
+                    rebalance(members, &list, false, errctx))
+                assigned = true;
+            error_log_saved(errctx);
+        }
 
-        /* Wait a little before reconnecting */
-        if (run) usleep(RECONNECT_INTERVAL_MS * 1000);
+        usleep(MAIN_TICK_MS * 1000);
     }
 
-    result = !errctx->saved;
+    result = true;
 
 CLEANUP:
 
-    /* Release resources acquired by metrics */
-    metrics_fini(&(ctx->metric_contexts));
+    /* Stop watchdog & stream workers, release their resources */
+    stream_watchdog_stop();
+    stream_list_free(&list);
+    cluster_free(&cluster);
+    metric_table_fini();
+    sink_fini();
+    history_fini();
 
     /* Output log if error occurred */
     error_log_saved(errctx);
@@ -132,13 +225,55 @@ static void usage(const char *command)
         "\tSTREAM_TIMEOUT_MS:     %u\n"
         "\tRECONNECT_INTERVAL_MS: %u\n"
         "\tGRAFANA_TIMEOUT_SECS:  %u\n\n"
-        "Usage:\n\t%s <URL> <sink address>\n\n",
+        "Optional Settings:\n"
+        "\t" METRIC_TABLE_ENVNAME "=<file>,<slots>: publish latest values to "
+        "shared-memory table\n"
+        "\t" SINK_SPOOL_ENVNAME "=<file>,<MB>[,<backfill KB/s>]: spool lines "
+        "while sink is down, backfill once it is back\n"
+        "\t" METRIC_SUPPRESS_ENVNAME "=<tolerance>,<heartbeat>: skip values "
+        "within relative tolerance of last sent, resending every heartbeat "
+        "intervals\n"
+        "\t" WATCHDOG_ENVNAME "=<path>,<check ms>[,<stall ms>[,<timeout ms>]]: "
+        "output stall durations\n"
+        "\t" METRIC_HISTORY_ENVNAME "=<socket>,<seconds>[,<series>]: keep "
+        "recent values, queried by \"<stream glob> <series glob> [<from> "
+        "[<to>]]\" lines\n"
+        "\t" OVERLOAD_ENVNAME "=<path>,<interval>[,<lag ms>[,<1 in N>]]: shed "
+        "work of low priority streams while watchdog ticks lag\n"
+        "\t" HIBERNATE_ENVNAME "=<idle ms>,<probe ms>: release metric state of "
+        "streams idle that long, reconnecting every probe interval\n\n"
+        "Usage:\n\t%s <URL> <sink address>\n"
+        "\t%s -l <stream list> [-m <members> [-n <name>] [-f <factor>] [-p]] "
+        "<sink address>\n"
+        "\t%s -r <capture> [-x <speed>] <sink address>\n"
+        "\t%s -b [-j <jobs>] [-s <split MB>] <recording>... <sink address>\n\n"
+        "Options:\n"
+        "\t-l: file of \"<name> <URL> [<group> [<priority>]]\" lines, name "
+        "prefixes metric paths, a group lists tiers of one stream upstream "
+        "first, or renditions of one channel if named \"" STREAM_GROUP_LADDER
+        "<name>\", priority 0 is never shed\n"
+        "\t-m: file of cluster member names, take only this member's share\n"
+        "\t-n: name of this member, defaults to host name\n"
+        "\t-f: bounded load factor of members, defaults to %.2f\n"
+        "\t-p: output streams taken by this member and exit\n"
+        "\t-c: capture received boxes to file, suffixed by name in list mode\n"
+        "\t-H: capture media data box headers only\n"
+        "\t-r: replay capture through metrics instead of receiving streams\n"
+        "\t-x: replay speed multiplier, 0 for maximum, defaults to 1\n"
+        "\t-b: analyse recorded files offline on media time, output merged "
+        "with metric paths prefixed by file name without extension\n"
+        "\t-j: parallel batch jobs, defaults to number of processors\n"
+        "\t-s: split recordings into jobs of about this size at fragments\n\n",
         STRINGIFY(COMMIT_HASH),
         STRINGIFY(BUILD_TIME),
         STREAM_TIMEOUT_MS,
         RECONNECT_INTERVAL_MS,
         GRAFANA_TIMEOUT_SECS,
-        command);
+        command,
+        command,
+        command,
+        command,
+        CLUSTER_DEFAULT_LOAD_FACTOR);
 
     /* Output supported metrics */
     fprintf(stderr, "Supported Metrics:\n");
@@ -153,6 +288,66 @@ static void usage(const char *command)
             transport_registry[idx]->desc);
 }
 
+static bool parse_options(int argc, char *argv[], options_t *options)
+{
+    int  opt   = -1;
+    bool batch = false;
+
+    options->load_factor = CLUSTER_DEFAULT_LOAD_FACTOR;
+    options->speed = 1.0;
+    while ((opt = getopt(argc, argv, "l:m:n:f:pc:Hr:x:bj:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l': options->streams = optarg; break;
+            case 'm': options->members = optarg; break;
+            case 'n': options->self = optarg; break;
+            case 'f': options->load_factor = strtod(optarg, NULL); break;
+            case 'p': options->print = true; break;
+            case 'c': options->capture = optarg; break;
+            case 'H': options->header_only = true; break;
+            case 'r': options->replay = optarg; break;
+            case 'x': options->speed = strtod(optarg, NULL); break;
+            case 'b': batch = true; break;
+            case 'j': options->jobs = strtoul(optarg, NULL, 10); break;
+            case 's': options->split_bytes = strtoull(optarg, NULL, 10) << 20;
+                      break;
+            default: return false;
+        }
+    }
+
+    /* Cluster mode only applies to stream lists */
+    if (options->members && !options->streams)
+        return false;
+    if (options->load_factor < 1.0 || options->speed < 0)
+        return false;
+
+    /* Replay takes the place of receiving streams */
+    if (options->replay && (options->streams || options->capture))
+        return false;
+
+    /* Batch mode takes recordings in place of everything else */
+    if (batch)
+    {
+        if (options->streams || options->capture || options->replay ||
+                argc - optind < 2)
+            return false;
+        options->recordings = &(argv[optind]);
+        options->recording_count = argc - optind - 1;
+        options->sink = argv[argc - 1];
+        return true;
+    }
+
+    /* Positional arguments, URL is replaced by stream list or capture */
+    if (argc - optind != ((options->streams || options->replay) ? 1 : 2))
+        return false;
+    if (!options->streams && !options->replay)
+        options->url = argv[optind++];
+    options->sink = argv[optind];
+
+    return true;
+}
+
 static void signal_handler(int signum)
 {
     run = false;
@@ -244,44 +439,54 @@ CLEANUP:
 }
 
 static bool
-on_fmp4_box(const fmp4_box_t *box,
-           void            *userdata,
-           error_context_t *errctx)
+rebalance(const cluster_t *cluster,
+          stream_list_t   *list,
+          bool             print,
+          error_context_t *errctx)
 {
-    context_t *ctx = NULL;
-
-    /* Sanity checks */
-    if (!box || !userdata || !errctx)
-        error_save_retval(errctx, EINVAL, false);
-
-    /* Cast userdata to context pointer */
-    ctx = (context_t *)(userdata);
-
-    /* Feed FMP4 box data to metrics */
-    if (!metrics_feed_data(ctx->metric_contexts, box, errctx))
-        return false;
-
-    /* Update stream callback timestamp */
-    ctx->last_callback_ms = current_time_milliseconds();
+    stream_t *stream = NULL;
+    bool     *owned  = NULL;
+    size_t    idx    = 0;
+    bool      result = false;
+
+    /* Without cluster membership every stream is ours */
+    owned = (bool *)(calloc(list->count, sizeof(bool)));
+    error_save_jump_if(!owned, errctx, errno, CLEANUP);
+    if (cluster)
+    {
+        if (!cluster_assign(cluster, list, owned, errctx))
+            goto CLEANUP;
+    }
+    else
+        memset(owned, true, list->count * sizeof(bool));
 
-    return true;
-}
+    /* Start newly owned streams and stop the ones handed over */
+    for (idx = 0; idx < list->count; idx++)
+    {
+        stream = &(list->streams[idx]);
+        if (print)
+        {
+            if (owned[idx])
+                printf("%s %s %s %" PRIu32 "\n",
+                        stream->name ? stream->name : "-", stream->url,
+                        stream->group ? stream->group : "-", stream->priority);
+            continue;
+        }
+        if (owned[idx] && !stream->started)
+        {
+            if (!stream_start(stream, errctx))
+                goto CLEANUP;
+        }
+        else if (!owned[idx] && stream->started)
+            stream_stop(stream);
+    }
 
-static bool timeout(const context_t *ctx)
-{
-    uint64_t now_ms  = 0;
-    uint64_t diff_ms = 0;
+    result = true;
 
-    /* Sanity checks */
-    if (!ctx)
-        return true;
+CLEANUP:
 
-    /* Calculate & check elapsed time */
-    now_ms = current_time_milliseconds();
-    diff_ms = now_ms - ctx->last_callback_ms;
-    if (diff_ms > STREAM_TIMEOUT_MS)
-        return true;
+    FREE_AND_NULLIFY(owned);
 
-    return false;
+    return result;
 }
 
@@ -0,0 +1,148 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   media_pacing.c
+ * Desc:   FMP4 media time versus arrival time pacing metric
+ */
+
+#include <fmp4.h>
+#include <inttypes.h>
+
+#include "error.h"
+#include "metric.h"
+
+/* Per-track pacing state, anchored at the first fragment of a timeline */
+typedef struct pace_t
+{
+    uint64_t anchor_media_ms;
+    uint64_t anchor_arrival_ms;
+    uint64_t start_media_ms;    // of current interval
+    uint64_t start_arrival_ms;
+    uint64_t last_media_ms;
+    bool     anchored;
+
+} pace_t;
+
+/* Internal metric context */
+typedef struct context_t
+{
+    uint32_t generation;        // of track table slots below
+    pace_t   paces[MAX_TRACKS];
+
+} context_t;
+
+static metric_context_t media_pacing_context(error_context_t *errctx);
+static bool media_pacing_emit(metric_context_t ctx, const fmp4_box_t *box,
+        error_context_t *errctx);
+
+static metric_t media_pacing =
+{
+    .envname = "MEDIA_PACING",
+    .masks   = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO,
+    .context = media_pacing_context,
+    .emit    = media_pacing_emit,
+};
+
+REGISTER_METRIC(media_pacing);
+
+static metric_context_t
+media_pacing_context(error_context_t *errctx)
+{
+    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    error_save_retval_if(!ctx, errctx, errno, NULL);
+    return (metric_context_t)(ctx);
+}
+
+static bool
+media_pacing_emit(metric_context_t  ctx,
+                  const fmp4_box_t  *box,
+                  error_context_t  *errctx)
+{
+    context_t              *metric_ctx = NULL;
+    const track_table_t    *tracks     = NULL;
+    const fragment_t       *fragment   = NULL;
+    const fragment_track_t *traf       = NULL;
+    pace_t                 *pace       = NULL;
+    char                    series[MAX_TRACK_SERIES_LEN + sizeof(".drift")] = {0};
+    uint64_t                now_ms     = 0;
+    uint64_t                media_ms   = 0;
+    uint64_t                arrival_ms = 0;
+    double                  ratio      = 0;
+    double                  drift_ms   = 0;
+    size_t                  idx        = 0;
+    int                     slot       = -1;
+
+    /* Sanity checks */
+    if (!ctx || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast context to internal metric context */
+    metric_ctx = (context_t *)(ctx);
+
+    /* Only fragments carry decode times */
+    switch (ntohl(box->type))
+    {
+        case 0x6d6f6f66: break; // moof box
+        default: return true;
+    }
+
+    /* Start over whenever track slots change */
+    now_ms = metrics_now_ms();
+    tracks = metrics_tracks();
+    if (metric_ctx->generation != tracks->generation)
+    {
+        memset(metric_ctx->paces, 0, sizeof(metric_ctx->paces));
+        metric_ctx->generation = tracks->generation;
+    }
+
+    fragment = metrics_fragment();
+    for (idx = 0; idx < fragment->track_count; idx++)
+    {
+        /* Media time needs decode time & timescale of track */
+        traf = &(fragment->tracks[idx]);
+        slot = track_table_slot(tracks, traf->track_id);
+        if (slot < 0 || !traf->has_decode_time ||
+                !tracks->tracks[slot].timescale)
+            continue;
+        pace = &(metric_ctx->paces[slot]);
+        media_ms = track_to_ms(&(tracks->tracks[slot]), traf->decode_time);
+
+        /* Re-anchor on first fragment and when the timeline jumps back */
+        if (!pace->anchored || media_ms < pace->last_media_ms)
+        {
+            pace->anchor_media_ms = pace->start_media_ms = media_ms;
+            pace->anchor_arrival_ms = pace->start_arrival_ms = now_ms;
+            pace->last_media_ms = media_ms;
+            pace->anchored = true;
+            continue;
+        }
+        pace->last_media_ms = media_ms;
+
+        /* Check if we are at the end of an interval time frame */
+        arrival_ms = now_ms - pace->start_arrival_ms;
+        if (arrival_ms < media_pacing.interval_ms)
+            continue;
+
+        /* Media time delivered per wallclock time, 1 when in real time */
+        ratio = (double)(media_ms - pace->start_media_ms) / (double)(arrival_ms);
+        (void)snprintf(series, sizeof(series), "%s.pace",
+                tracks->tracks[slot].series);
+        if (!metric_output(&media_pacing, series, ratio, 3, now_ms, errctx))
+            return false;
+
+        /* Media time ahead of (positive) or behind wallclock since anchor */
+        drift_ms = (double)(media_ms - pace->anchor_media_ms) -
+            (double)(now_ms - pace->anchor_arrival_ms);
+        (void)snprintf(series, sizeof(series), "%s.drift",
+                tracks->tracks[slot].series);
+        if (!metric_output(&media_pacing, series, drift_ms, 0, now_ms, errctx))
+            return false;
+
+        /* Reset interval start */
+        pace->start_media_ms = media_ms;
+        pace->start_arrival_ms = now_ms;
+    }
+
+    return true;
+}
+
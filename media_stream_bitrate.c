@@ -11,37 +11,53 @@
 #include "error.h"
 #include "metric.h"
 
-#define MAX_MEDIA_FRAME_SIZE (4 * 1024 * 1024)
-
 /* Internal metric context */
 typedef struct context_t
 {
     uint64_t init_time_ms;
     uint64_t prev_time_ms;
-    uint32_t nxt_mdat_track_id;
-    size_t   audio_bytes;
-    size_t   video_bytes;
+    uint32_t generation;          // of track table bytes are counted for
+    uint64_t bytes[MAX_TRACKS];   // per track table slot
+    window_t windows[];           // per slot, window_count each
 
 } context_t;
 
+static bool media_stream_bitrate_configure(const char *options,
+        error_context_t *errctx);
 static metric_context_t media_stream_bitrate_context(error_context_t *errctx);
 static bool media_stream_bitrate_emit(metric_context_t ctx,
         const fmp4_box_t *box, error_context_t *errctx);
 
 static metric_t media_stream_bitrate =
 {
-    .envname = "MEDIA_STREAM_BITRATE",
-    .masks   = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO,
-    .context = media_stream_bitrate_context,
-    .emit    = media_stream_bitrate_emit,
+    .envname   = "MEDIA_STREAM_BITRATE",
+    .masks     = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO,
+    .context   = media_stream_bitrate_context,
+    .emit      = media_stream_bitrate_emit,
+    .configure = media_stream_bitrate_configure,
 };
 
 REGISTER_METRIC(media_stream_bitrate);
 
+/* Extra sliding & EWMA windows, same for every stream */
+static window_spec_t window_specs[MAX_WINDOWS] = {};
+static size_t        window_count              = 0;
+
+static bool
+media_stream_bitrate_configure(const char      *options,
+                               error_context_t *errctx)
+{
+    window_count = window_parse(options, window_specs, MAX_WINDOWS, errctx);
+    return window_count != SIZE_MAX;
+}
+
 static metric_context_t
 media_stream_bitrate_context(error_context_t *errctx)
 {
-    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    context_t *ctx = NULL;
+
+    ctx = (context_t *)(calloc(1, sizeof(context_t) +
+                MAX_TRACKS * window_count * sizeof(window_t)));
     error_save_retval_if(!ctx, errctx, errno, NULL);
     return (metric_context_t)(ctx);
 }
@@ -51,12 +67,16 @@ media_stream_bitrate_emit(metric_context_t  ctx,
                           const fmp4_box_t  *box,
                           error_context_t  *errctx)
 {
-    context_t *metric_ctx = NULL;
-    uint64_t   now_ms     = 0;
-    uint64_t   diff_ms    = 0;
-    float      audio_bps  = 0;
-    float      video_bps  = 0;
-    int        ret        = -1;
+    context_t           *metric_ctx = NULL;
+    const track_table_t *tracks     = NULL;
+    const fragment_t    *fragment   = NULL;
+    uint64_t             now_ms     = 0;
+    uint64_t             diff_ms    = 0;
+    uint64_t             count      = 0;
+    float                bps        = 0;
+    size_t               idx        = 0;
+    size_t               widx       = 0;
+    int                  slot       = -1;
 
     /* Sanity checks */
     if (!ctx || !box || !errctx)
@@ -68,64 +88,68 @@ media_stream_bitrate_emit(metric_context_t  ctx,
     /* Increment the number of bytes received */
     switch (ntohl(box->type))
     {
-        case 0x6d6f6f66: { // moof
-            fmp4_box_t* curBox;
-            /* move to moof child - mfhd box */
-            curBox = (fmp4_box_t*)box->body;
-            /* move to mfhd sibling - traf box */
-            curBox = (fmp4_box_t*)( (uint8_t*)curBox + ntohl(curBox->size) );
-            /* move to traf child - tfhd */
-            curBox = (fmp4_box_t*)curBox->body;
-	    /* decide next mdat box track ID */
-	    fmp4_full_box_t* tfhd = (fmp4_full_box_t*)curBox;
-            uint32_t* track_id = (uint32_t*)tfhd->body;
-            metric_ctx->nxt_mdat_track_id = ntohl(*track_id);
-            break;
-	}
-        case 0x6d646174: { // mdat
-	    int framesize = ntohl(box->size);
-	    if (framesize <= 0 || framesize > MAX_MEDIA_FRAME_SIZE) {
-	        return true;
-	    }
-	    if (metric_ctx->nxt_mdat_track_id == 1) {
-	        metric_ctx->video_bytes += framesize;
-	    } else if (metric_ctx->nxt_mdat_track_id == 2)  {
-	        metric_ctx->audio_bytes += framesize;
-	    }
-	    break;
-	}
-	default: return true;
+        case 0x6d6f6f66: break; // moof box
+        default: return true;
+    }
+
+    /* Sum sample sizes of every track run, starting over on new tracks */
+    tracks = metrics_tracks();
+    if (metric_ctx->generation != tracks->generation)
+    {
+        memset(metric_ctx->bytes, 0, sizeof(metric_ctx->bytes));
+        for (idx = 0; idx < MAX_TRACKS * window_count; idx++)
+            window_init(&(metric_ctx->windows[idx]),
+                    &(window_specs[idx % window_count]));
+        metric_ctx->generation = tracks->generation;
+    }
+    now_ms = metrics_now_ms();
+    fragment = metrics_fragment();
+    for (idx = 0; idx < fragment->track_count; idx++)
+    {
+        slot = track_table_slot(tracks, fragment->tracks[idx].track_id);
+        if (slot < 0)
+            continue;
+
+        /* Sampled fragments count for the ones left out too */
+        count = fragment->tracks[idx].sample_bytes * metrics_weight();
+        metric_ctx->bytes[slot] += count;
+        for (widx = 0; widx < window_count; widx++)
+            window_add(&(metric_ctx->windows[slot * window_count + widx]),
+                    now_ms, count);
     }
 
     /* Initialize tracking timestamps */
-    now_ms = current_time_milliseconds();
     if (metric_ctx->init_time_ms == 0)
         metric_ctx->init_time_ms = metric_ctx->prev_time_ms = now_ms;
 
-    /* Check if we're still within warmup period */
+    /* Check if we're still within warmup period, first interval starts after */
     if (now_ms - metric_ctx->init_time_ms < media_stream_bitrate.interval_ms)
+    {
+        memset(metric_ctx->bytes, 0, sizeof(metric_ctx->bytes));
+        metric_ctx->prev_time_ms = now_ms;
         return true;
+    }
 
     /* Check if we are at the end of an interval time frame */
     diff_ms = now_ms - metric_ctx->prev_time_ms;
     if (diff_ms <= 0) return true;
     if (diff_ms >= media_stream_bitrate.interval_ms)
     {
-        /* Calculate audio bitrate */
-        audio_bps = (float)(metric_ctx->audio_bytes) * 1000 / (float)(diff_ms);
-        audio_bps *= 8; // Convert to bits per second
-        ret = printf("%s.audio %.2f %" PRIu64 "\n",
-                media_stream_bitrate.path, audio_bps, now_ms / 1000);
-        error_save_retval_if(ret < 0, errctx, errno, false);
-        metric_ctx->audio_bytes = 0;
-
-        /* Calculate video bitrate */
-        video_bps = (float)(metric_ctx->video_bytes) * 1000 / (float)(diff_ms);
-        video_bps *= 8; // Convert to bits per second
-        ret = printf("%s.video %.2f %" PRIu64 "\n",
-                media_stream_bitrate.path, video_bps, now_ms / 1000);
-        error_save_retval_if(ret < 0, errctx, errno, false);
-        metric_ctx->video_bytes = 0;
+        /* Calculate bitrate of each track */
+        for (idx = 0; idx < tracks->count; idx++)
+        {
+            bps = (float)(metric_ctx->bytes[idx]) * 1000 / (float)(diff_ms);
+            bps *= 8; // Convert to bits per second
+            if (!metric_output(&media_stream_bitrate,
+                        tracks->tracks[idx].series, bps, 2, now_ms, errctx))
+                return false;
+            if (!metric_output_windows(&media_stream_bitrate,
+                        tracks->tracks[idx].series,
+                        &(metric_ctx->windows[idx * window_count]),
+                        window_count, true, 8, 2, now_ms, errctx))
+                return false;
+            metric_ctx->bytes[idx] = 0;
+        }
 
         /* Reset previous time */
         metric_ctx->prev_time_ms = now_ms;
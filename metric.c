@@ -5,35 +5,75 @@
  * Desc:   FMP4 stream metric interface implementation
  */
 
+#include <inttypes.h>
+#include <math.h>
+
+#include "box.h"
+#include "history.h"
 #include "metric.h"
+#include "metric_table.h"
+#include "sink.h"
 
 /* Global metric names, registry, and registered metrics count */
 const char *metrics_supported[MAX_METRICS_COUNT] = {};
 const metric_t *metrics_registry[MAX_METRICS_COUNT] = {};
 size_t supported_count = 0, registered_count = 0;
 
+/* Set once metric output fails to reach the sink */
+volatile bool metrics_output_failed = false;
+
+/* Stream the calling thread's metric output is attributed to */
+static const metric_stream_t default_stream = {};
+static __thread const metric_stream_t *bound_stream = &default_stream;
+
+/* Tracks of the last moov & sample table summary of the last moof */
+static __thread track_table_t current_tracks = {};
+static __thread fragment_t current_fragment = {};
+
+/* Last value sent per series & intervals suppressed since */
+typedef struct suppressed_t
+{
+    uint64_t key;       // path hash mixed with stream id, 0 if free
+    double   value;
+    uint32_t skipped;
+
+} suppressed_t;
+
+/* Relative tolerance & heartbeat, in intervals, of change suppression */
+static double   suppress_tolerance = 0;
+static uint32_t suppress_heartbeat = 0;
+static __thread suppressed_t *suppressed = NULL;
+
+static bool metric_suppress(uint64_t key, double value);
+static bool metrics_alloc(metric_context_t *metric_contexts,
+        error_context_t *errctx);
+
 bool
 metrics_init(metric_context_t **metric_contexts,
              error_context_t   *errctx)
 {
-    size_t idx    = 0;
-    bool   result = false;
+    bool result = false;
 
     /* Sanity checks */
     if (!metric_contexts || !errctx)
         error_save_jump(errctx, EINVAL, CLEANUP);
 
-    /* Allocate array for list of metric contexts */
+    /* Tracks are unknown until the connection delivers a moov */
+    track_table_reset(&current_tracks);
+
+    /*
+     * Allocate array for list of metric contexts, contexts themselves are
+     * generated with the first box so that offline streams hold none
+     */
     *metric_contexts = (metric_context_t *)(calloc(registered_count,
                 sizeof(metric_context_t)));
     error_save_jump_if(!*metric_contexts, errctx, errno, CLEANUP);
 
-    /* Generate contexts for each metric */
-    for (idx = 0; idx < registered_count; idx++)
-    {
-        (*metric_contexts)[idx] = metrics_registry[idx]->context(errctx);
-        error_save_jump_if(!(*metric_contexts)[idx], errctx, errno, CLEANUP);
-    }
+#ifdef METRIC_STATIC_PIPELINE
+    /* Resolve context slots of statically dispatched metrics */
+    if (!metrics_pipeline_bind(errctx))
+        goto CLEANUP;
+#endif
 
     result = true;
 
@@ -47,9 +87,10 @@ CLEANUP:
 
 bool metric_config(metric_t *metric)
 {
-    const char *config = NULL;
-    const char *comma  = NULL;
-    int         ret    = -1;
+    error_context_t errctx = {};
+    const char     *config = NULL;
+    const char     *comma  = NULL;
+    int             ret    = -1;
 
     /* Sanity checks */
     if (!metric || !metric->envname)
@@ -72,6 +113,20 @@ bool metric_config(metric_t *metric)
     if (metric->interval_ms == ULLONG_MAX || metric->interval_ms == 0)
         return false;
 
+    /* Keep any further values for metric to parse, e.g. thresholds */
+    comma = strchr(comma + 1, ',');
+    if (comma)
+    {
+        ret = snprintf(metric->options, sizeof(metric->options), "%s",
+                comma + 1);
+        if (ret < 0 || ret >= sizeof(metric->options))
+            return false;
+    }
+
+    /* Let metric parse its options now, read-only once streams start */
+    if (metric->configure && !metric->configure(metric->options, &errctx))
+        return false;
+
     return true;
 }
 
@@ -86,16 +141,26 @@ metrics_feed_data(metric_context_t *metric_contexts,
     if (!metric_contexts || !box || !errctx)
         error_save_retval(errctx, EINVAL, false);
 
-    /* Set mask of media box */
+    /* Generate contexts on first box, all at once or none */
+    if (unlikely(registered_count && !metric_contexts[0]) &&
+            !metrics_alloc(metric_contexts, errctx))
+        return false;
+
+    /* Parse tracks once per moov & sample tables once per moof for metrics */
     switch (ntohl(box->type))
     {
-	case 0x66747970: /*fprintf(stderr, "box is ftyp\n");*/ break;
-	case 0x6d6f6f76: /*fprintf(stderr, "box is moov\n");*/ break;
- 	case 0x6d6f6f66: /*fprintf(stderr, "box is moof\n");*/ break;
-	case 0x6d646174: /*fprintf(stderr, "box is mdat\n");*/ break;
-	default: /*fprintf(stderr, "unknown box\n");*/ break;
+        case BOX_TYPE_MOOV: (void)track_table_parse(&current_tracks, box); break;
+        case BOX_TYPE_MOOF:
+            (void)fragment_parse(&current_fragment, box, &current_tracks);
+            break;
+        default: break;
     }
 
+#ifdef METRIC_STATIC_PIPELINE
+    /* Invoke emit functions of the fixed metric set directly */
+    (void)idx;
+    return metrics_pipeline_feed(metric_contexts, box, errctx);
+#else
     /* Cycle through and invoke emit function for each metric */
     for (idx = 0; idx < registered_count; idx++)
     {
@@ -104,20 +169,267 @@ metrics_feed_data(metric_context_t *metric_contexts,
     }
 
     return true;
+#endif
 }
 
-void metrics_fini(metric_context_t **metric_contexts)
+void metrics_release(metric_context_t *metric_contexts)
 {
     size_t idx = 0;
 
     /* Sanity checks */
-    if (!metric_contexts || !*metric_contexts)
+    if (!metric_contexts)
         return;
 
-    /* Free allocated contexts */
+    /* Free allocated contexts & state of thread, next box starts over */
     for (idx = 0; idx < registered_count; idx++)
-        if ((*metric_contexts)[idx])
-            FREE_AND_NULLIFY((*metric_contexts)[idx]);
+    {
+        if (!metric_contexts[idx])
+            continue;
+        if (metrics_registry[idx]->release)
+            metrics_registry[idx]->release(metric_contexts[idx]);
+        FREE_AND_NULLIFY(metric_contexts[idx]);
+    }
+    FREE_AND_NULLIFY(suppressed);
+    track_table_reset(&current_tracks);
+    memset(&current_fragment, 0, sizeof(current_fragment));
+}
+
+void metrics_fini(metric_context_t **metric_contexts)
+{
+    /* Sanity checks */
+    if (!metric_contexts || !*metric_contexts)
+        return;
+
+    /* Free allocated contexts & list of them */
+    metrics_release(*metric_contexts);
     FREE_AND_NULLIFY(*metric_contexts);
 }
 
+
+void metrics_bind_stream(const metric_stream_t *stream)
+{
+    bound_stream = stream ? stream : &default_stream;
+}
+
+const metric_stream_t *metrics_stream(void)
+{
+    return bound_stream;
+}
+
+uint64_t metrics_now_ms(void)
+{
+    /* Box receive time, recorded time for replayed & offline streams */
+    if (bound_stream->clock_ms)
+        return bound_stream->clock_ms;
+
+    return current_time_milliseconds();
+}
+
+const track_table_t *metrics_tracks(void)
+{
+    return &current_tracks;
+}
+
+const fragment_t *metrics_fragment(void)
+{
+    return &current_fragment;
+}
+
+uint32_t metrics_weight(void)
+{
+    return bound_stream->weight ? bound_stream->weight : 1;
+}
+
+uint64_t metrics_hash(const char *str)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL; // 64-bit FNV-1a
+
+    while (str && *str)
+    {
+        hash ^= (uint8_t)(*str++);
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+bool
+metric_output(const metric_t   *metric,
+              const char       *series,
+              double            value,
+              int               precision,
+              uint64_t          now_ms,
+              error_context_t  *errctx)
+{
+    char     path[MAX_PATH_LEN * 2] = {0};
+    char     line[MAX_PATH_LEN * 3] = {0};
+    uint64_t hash                   = 0;
+    int      ret                    = -1;
+
+    /* Sanity checks */
+    if (!metric || !series || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Compose full metric path, prefixed by stream name if any */
+    if (bound_stream->name)
+        ret = snprintf(path, sizeof(path), "%s.%s%s", bound_stream->name,
+                metric->path, series);
+    else
+        ret = snprintf(path, sizeof(path), "%s%s", metric->path, series);
+    error_save_retval_if(ret <= 0 || ret >= sizeof(path), errctx, EINVAL, false);
+    hash = metrics_hash(path);
+
+    /* Keep recent history of every value, sent or suppressed */
+    history_record(hash ^ bound_stream->id, bound_stream->name,
+            path + (bound_stream->name ? strlen(bound_stream->name) + 1 : 0),
+            value, precision, now_ms);
+
+    /* Skip sink output of values unchanged, buffered output is kept whole */
+    if (!bound_stream->output && metric_suppress(hash ^ bound_stream->id,
+                value))
+    {
+        metric_table_publish(bound_stream->id, hash ^ bound_stream->id, path,
+                value, now_ms);
+        return true;
+    }
+
+    /* Output metric to buffer of stream if it has one, or to sink */
+    ret = snprintf(line, sizeof(line), "%s %.*f %" PRIu64 "\n", path,
+            precision, value, now_ms / 1000);
+    error_save_retval_if(ret <= 0 || ret >= sizeof(line), errctx, EINVAL, false);
+    if (bound_stream->output)
+    {
+        ret = fwrite(line, ret, 1, bound_stream->output) == 1 ? 0 : -1;
+        error_save_retval_if(ret < 0, errctx, errno, false);
+    }
+    else
+        (void)sink_write(line, ret); // outages spool or drop, never fail streams
+
+    /* Publish latest value for local readers */
+    metric_table_publish(bound_stream->id, hash ^ bound_stream->id, path,
+            value, now_ms);
+
+    return true;
+}
+
+bool
+metric_output_windows(const metric_t   *metric,
+                      const char       *series,
+                      window_t         *windows,
+                      size_t            count,
+                      bool              rate,
+                      double            scale,
+                      int               precision,
+                      uint64_t          now_ms,
+                      error_context_t  *errctx)
+{
+    char   path[MAX_TRACK_SERIES_LEN + MAX_WINDOW_SERIES_LEN + 1] = {0};
+    double value                                                 = 0;
+    size_t idx                                                   = 0;
+    int    ret                                                   = -1;
+
+    /* Sanity checks */
+    if (!metric || !series || (!windows && count) || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Output rate per second or mean of each window, suffixed by its span */
+    for (idx = 0; idx < count; idx++)
+    {
+        ret = snprintf(path, sizeof(path), "%s%s", series,
+                windows[idx].spec.series);
+        error_save_retval_if(ret <= 0 || ret >= sizeof(path), errctx, EINVAL,
+                false);
+        value = rate ? window_rate(&(windows[idx]), now_ms) :
+            window_mean(&(windows[idx]), now_ms);
+        if (!metric_output(metric, path, value * scale, precision, now_ms,
+                    errctx))
+            return false;
+    }
+
+    return true;
+}
+
+__attribute__((constructor)) static void metric_suppress_config()
+{
+    const char *config = NULL;
+    char       *comma  = NULL;
+
+    /* Suppression is optional, "<relative tolerance>,<heartbeat intervals>" */
+    config = getenv(METRIC_SUPPRESS_ENVNAME);
+    if (!config)
+        return;
+    suppress_tolerance = strtod(config, &comma);
+    if (*comma != ',' || !(suppress_tolerance >= 0))
+        return;
+    suppress_heartbeat = (uint32_t)(strtoul(comma + 1, NULL, 10));
+}
+
+static bool metric_suppress(uint64_t key, double value)
+{
+    suppressed_t *entry = NULL;
+    size_t        probe = 0;
+
+    /* Disabled unless a heartbeat of more than one interval is set */
+    if (suppress_heartbeat <= 1)
+        return false;
+    if (!suppressed)
+        suppressed = (suppressed_t *)(calloc(MAX_SUPPRESSED_SERIES,
+                    sizeof(suppressed_t)));
+    if (!suppressed)
+        return false;
+
+    /* Find series, or take a free entry for it; series beyond are all sent */
+    key = key ? key : 1;
+    for (probe = 0; probe < MAX_SUPPRESS_PROBES; probe++)
+    {
+        entry = &(suppressed[(key + probe) % MAX_SUPPRESSED_SERIES]);
+        if (entry->key == key)
+            break;
+        if (entry->key == 0)
+        {
+            entry->key = key;
+            entry->value = value;
+            entry->skipped = 0;
+            return false;
+        }
+    }
+    if (probe == MAX_SUPPRESS_PROBES)
+        return false;
+
+    /* Unchanged within tolerance of value last sent, until heartbeat is due */
+    if (fabs(value - entry->value) <= suppress_tolerance * fabs(entry->value) &&
+            entry->skipped + 1 < suppress_heartbeat)
+    {
+        ++(entry->skipped);
+        return true;
+    }
+    entry->value = value;
+    entry->skipped = 0;
+
+    return false;
+}
+
+static bool
+metrics_alloc(metric_context_t *metric_contexts,
+              error_context_t  *errctx)
+{
+    size_t idx    = 0;
+    bool   result = false;
+
+    /* Generate contexts for each metric */
+    for (idx = 0; idx < registered_count; idx++)
+    {
+        metric_contexts[idx] = metrics_registry[idx]->context(errctx);
+        error_save_jump_if(!metric_contexts[idx], errctx, errno, CLEANUP);
+    }
+
+    result = true;
+
+CLEANUP:
+
+    if (!result)
+        metrics_release(metric_contexts);
+
+    return result;
+}
+
@@ -16,6 +16,9 @@
 
 #include "common.h"
 #include "error.h"
+#include "fragment.h"
+#include "track.h"
+#include "window.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -33,8 +36,14 @@ extern "C"
     /* Maximum length of Grafana path of metric */
     #define MAX_PATH_LEN 256
 
+    /* Change suppression of sink output, series tracked per thread */
+    #define METRIC_SUPPRESS_ENVNAME   "METRIC_SUPPRESS"
+    #define MAX_SUPPRESSED_SERIES     1024
+    #define MAX_SUPPRESS_PROBES       16
+
     /* Per-metric module registration function */
     #define REGISTER_METRIC(metric) \
+        METRIC_PIPELINE_ENTRY(metric) \
         __attribute__((constructor)) static void register_##metric() \
         { \
             assert(supported_count < MAX_METRICS_COUNT); \
@@ -48,39 +57,119 @@ extern "C"
             metrics_supported[supported_count++] = metric.envname; \
         }
 
+    /* Static pipeline entry points, emit function must be named <metric>_emit */
+    #ifdef METRIC_STATIC_PIPELINE
+    #define METRIC_PIPELINE_ENTRY(metric) \
+        const metric_t *const metric_static_##metric = &metric; \
+        bool metric_static_emit_##metric(metric_context_t ctx, \
+                const fmp4_box_t *box, error_context_t *errctx) \
+        { \
+            return metric##_emit(ctx, box, errctx); \
+        }
+    #else
+    #define METRIC_PIPELINE_ENTRY(metric)
+    #endif
+
     /* Per-metric implementation function pointers types */
     typedef void * metric_context_t;
     typedef metric_context_t (*metric_context_functor_t)(
             error_context_t *errctx); // allocated context needs be free()'d
     typedef bool (*metric_emit_functor_t)(metric_context_t ctx,
             const fmp4_box_t *box, error_context_t *errctx);
+    typedef void (*metric_release_functor_t)(
+            metric_context_t ctx); // optional, called before free()
+    typedef bool (*metric_configure_functor_t)(const char *options,
+            error_context_t *errctx); // optional, once at registration
 
     /* Transport context definition */
     typedef struct metric_t
     {
-        const char                     *envname;
-        char                            path[MAX_PATH_LEN + 1];
-        uint64_t                        interval_ms;
-        const uint8_t                   masks;
-        const metric_context_functor_t  context;
-        const metric_emit_functor_t     emit;
+        const char                      *envname;
+        char                             path[MAX_PATH_LEN + 1];
+        uint64_t                         interval_ms;
+        char                             options[MAX_PATH_LEN + 1]; // rest
+        const uint8_t                    masks;
+        const metric_context_functor_t   context;
+        const metric_emit_functor_t      emit;
+        const metric_release_functor_t   release;
+        const metric_configure_functor_t configure;
 
     } metric_t;
 
+    /* Kinds of stream groups, what streams of a group are to each other */
+    typedef enum metric_group_kind_t
+    {
+        METRIC_GROUP_TIERS,   // one stream received from successive tiers
+        METRIC_GROUP_LADDER,  // renditions of one channel
+
+    } metric_group_kind_t;
+
+    /* Stream identity metric output is attributed to */
+    typedef struct metric_stream_t
+    {
+        const char *url;
+        const char *name;   // metric path prefix, NULL if none
+        uint64_t    id;
+        uint64_t    clock_ms; // receive time of current box, 0 for wallclock
+        FILE       *output;   // NULL for stdout
+
+        /* Current connection attempt, 0 for replayed & offline streams */
+        uint32_t    connection;
+        uint64_t    connect_start_ms;
+        uint64_t    resolved_ms;  // 0 if no host name was resolved
+        uint64_t    connected_ms;
+        int         socket_fd;    // of connection if seen, 0 if not
+
+        /* Group of streams correlated by metrics of its kind, 0 if none */
+        uint64_t            group;
+        metric_group_kind_t group_kind;
+        uint32_t            tier;     // position within group, 0 first listed
+
+        /* Fragments the current one stands for, 0 if none left out before */
+        uint32_t    weight;
+
+    } metric_stream_t;
+
     /* Global metric names, registry, and registered metrics count */
     #define MAX_METRICS_COUNT 256
     extern const char *metrics_supported[MAX_METRICS_COUNT];
     extern const metric_t *metrics_registry[MAX_METRICS_COUNT];
     extern size_t supported_count, registered_count;
 
+    /* Set once metric output fails to reach the sink */
+    extern volatile bool metrics_output_failed;
+
     /* Exported public functions */
     bool metrics_init(metric_context_t **metric_contexts,
             error_context_t *errctx);
     bool metric_config(metric_t *metric);
     bool metrics_feed_data(metric_context_t *metric_contexts,
             const fmp4_box_t *box, error_context_t *errctx);
+    void metrics_release(metric_context_t *metric_contexts);
     void metrics_fini(metric_context_t **metric_contexts);
 
+    /* Statically dispatched pipeline, generated for a fixed metric set */
+    #ifdef METRIC_STATIC_PIPELINE
+    bool metrics_pipeline_bind(error_context_t *errctx);
+    bool metrics_pipeline_feed(metric_context_t *metric_contexts,
+            const fmp4_box_t *box, error_context_t *errctx);
+    #endif
+
+    /* Metric output helpers, stream binding is per calling thread */
+    void metrics_bind_stream(const metric_stream_t *stream);
+    const metric_stream_t *metrics_stream(void);
+    uint64_t metrics_now_ms(void);
+    const track_table_t *metrics_tracks(void);
+    const fragment_t *metrics_fragment(void);
+    uint32_t metrics_weight(void);
+    uint64_t metrics_hash(const char *str);
+    bool metric_output(const metric_t *metric, const char *series,
+            double value, int precision, uint64_t now_ms,
+            error_context_t *errctx);
+    bool metric_output_windows(const metric_t *metric, const char *series,
+            window_t *windows, size_t count, bool rate, double scale,
+            int precision, uint64_t now_ms, error_context_t *errctx);
+
 #ifdef __cplusplus
 }
 #endif
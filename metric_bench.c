@@ -0,0 +1,295 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   metric_bench.c
+ * Desc:   Per-box metric pipeline cost benchmark
+ */
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fmp4.h>
+
+#include "box.h"
+#include "error.h"
+#include "metric.h"
+
+#define BENCH_ROUNDS        (20000)
+#define BENCH_FRAGMENTS     (8)
+#define BENCH_SAMPLES       (30)
+#define BENCH_BUFFER_SIZE   (1024 * 1024)
+#define BENCH_TIMESCALE     (90000)
+#define BENCH_DURATION      (BENCH_TIMESCALE / 30) // per sample
+#define BENCH_MAX_BOXES     (2 + BENCH_FRAGMENTS * 3)
+#define BENCH_METRIC_CONFIG "bench,1000"
+#define BENCH_REEXEC_ENV    "METRIC_BENCH_REEXEC"
+
+#ifdef METRIC_STATIC_PIPELINE
+#define BENCH_PIPELINE "static"
+#else
+#define BENCH_PIPELINE "dynamic"
+#endif
+
+/* Synthetic stream, boxes laid out back to back */
+typedef struct bench_stream_t
+{
+    uint8_t           buffer[BENCH_BUFFER_SIZE];
+    size_t            length;
+    const fmp4_box_t *boxes[BENCH_MAX_BOXES];
+    size_t            count;
+    size_t            init_count; // ftyp & moov, fed once per connection
+    uint8_t          *decode_times[BENCH_FRAGMENTS]; // of tfdt, big-endian
+
+} bench_stream_t;
+
+static uint8_t *bench_box_begin(bench_stream_t *stream, const char *type);
+static void bench_box_end(bench_stream_t *stream, uint8_t *box, bool top);
+static void bench_put32(bench_stream_t *stream, uint32_t value);
+static void bench_put64(bench_stream_t *stream, uint64_t value);
+static void bench_generate_moov(bench_stream_t *stream);
+static void bench_generate(bench_stream_t *stream);
+static void bench_advance(bench_stream_t *stream);
+static uint64_t bench_time_ns(void);
+
+static bench_stream_t  stream       = {};
+static metric_stream_t bench_metric =
+{
+    .url        = "bench://" BENCH_PIPELINE,
+    .group_kind = METRIC_GROUP_LADDER,
+};
+
+int main(int argc, char *argv[])
+{
+    metric_context_t *metric_contexts = NULL;
+    error_context_t   _errctx         = {};
+    error_context_t  *errctx          = &_errctx;
+    uint64_t          rounds          = BENCH_ROUNDS;
+    uint64_t          begin_ns        = 0;
+    uint64_t          elapsed_ns      = 0;
+    uint64_t          round           = 0;
+    size_t            idx             = 0;
+    bool              result          = false;
+
+    if (argc > 1)
+        rounds = strtoull(argv[1], NULL, 10);
+
+    /* Metrics configure at startup, so enable all of them and re-execute */
+    if (registered_count == 0)
+    {
+        error_save_jump_if(getenv(BENCH_REEXEC_ENV), errctx, ENOENT, CLEANUP);
+        for (idx = 0; idx < supported_count; idx++)
+            setenv(metrics_supported[idx], BENCH_METRIC_CONFIG, 1);
+        setenv(BENCH_REEXEC_ENV, "1", 1);
+        execvp(argv[0], argv);
+        error_save_jump(errctx, errno, CLEANUP);
+    }
+
+    /* Discard metric output, only the pipeline is measured */
+    if (!freopen("/dev/null", "w", stdout))
+        error_save_jump(errctx, errno, CLEANUP);
+
+    /* Stream is a rendition of a ladder, so grouped metrics measure too */
+    bench_metric.group = (metrics_hash(BENCH_PIPELINE) ^
+            ((uint64_t)(bench_metric.group_kind) << 63)) | 1;
+    metrics_bind_stream(&bench_metric);
+
+    /* Initialize metrics & synthetic stream */
+    if (!metrics_init(&metric_contexts, errctx))
+        error_save_jump(errctx, errno, CLEANUP);
+    bench_generate(&stream);
+
+    /* Feed initialization segment once, then every fragment repeatedly */
+    for (idx = 0; idx < stream.init_count; idx++)
+    {
+        if (!metrics_feed_data(metric_contexts, stream.boxes[idx], errctx))
+            error_save_jump(errctx, errno, CLEANUP);
+    }
+    begin_ns = bench_time_ns();
+    for (round = 0; round < rounds; round++)
+    {
+        for (idx = stream.init_count; idx < stream.count; idx++)
+        {
+            if (!metrics_feed_data(metric_contexts, stream.boxes[idx], errctx))
+                error_save_jump(errctx, errno, CLEANUP);
+        }
+        bench_advance(&stream);
+    }
+    elapsed_ns = bench_time_ns() - begin_ns;
+
+    /* Output results */
+    fprintf(stderr, "Pipeline: %s\nMetrics:  %zu\nBoxes:    %" PRIu64 "\n"
+            "Per-box:  %.1f ns\n", BENCH_PIPELINE, registered_count,
+            rounds * (stream.count - stream.init_count),
+            (double)(elapsed_ns) /
+            (double)(rounds * (stream.count - stream.init_count)));
+
+    result = true;
+
+CLEANUP:
+
+    metrics_fini(&metric_contexts);
+    metrics_bind_stream(NULL);
+
+    /* Output log if error occurred */
+    error_log_saved(errctx);
+
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static uint8_t *bench_box_begin(bench_stream_t *stream, const char *type)
+{
+    uint8_t *box = stream->buffer + stream->length;
+
+    bench_put32(stream, 0);
+    memcpy(stream->buffer + stream->length, type, 4);
+    stream->length += 4;
+
+    return box;
+}
+
+static void bench_box_end(bench_stream_t *stream, uint8_t *box, bool top)
+{
+    uint32_t size = htonl((uint32_t)(stream->buffer + stream->length - box));
+
+    memcpy(box, &size, sizeof(size));
+    if (top)
+        stream->boxes[stream->count++] = (const fmp4_box_t *)(box);
+}
+
+static void bench_put32(bench_stream_t *stream, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(stream->buffer + stream->length, &value, sizeof(value));
+    stream->length += sizeof(value);
+}
+
+static void bench_put64(bench_stream_t *stream, uint64_t value)
+{
+    bench_put32(stream, (uint32_t)(value >> 32));
+    bench_put32(stream, (uint32_t)(value));
+}
+
+static void bench_generate_moov(bench_stream_t *stream)
+{
+    uint8_t *boxes[4] = {};
+
+    /* Movie, one video track with the timescale fragments are timed in */
+    boxes[0] = bench_box_begin(stream, "moov");
+    boxes[1] = bench_box_begin(stream, "trak");
+    boxes[2] = bench_box_begin(stream, "tkhd");
+    bench_put32(stream, 0x000003);
+    bench_put64(stream, 0);
+    bench_put32(stream, 1);
+    bench_put64(stream, 0);
+    bench_box_end(stream, boxes[2], false);
+    boxes[2] = bench_box_begin(stream, "mdia");
+    boxes[3] = bench_box_begin(stream, "mdhd");
+    bench_put32(stream, 0);
+    bench_put64(stream, 0);
+    bench_put32(stream, BENCH_TIMESCALE);
+    bench_put64(stream, 0);
+    bench_box_end(stream, boxes[3], false);
+    boxes[3] = bench_box_begin(stream, "hdlr");
+    bench_put64(stream, 0);
+    bench_put32(stream, 0x76696465); // vide
+    bench_put64(stream, 0);
+    bench_put64(stream, 0);
+    bench_box_end(stream, boxes[3], false);
+    bench_box_end(stream, boxes[2], false);
+    bench_box_end(stream, boxes[1], false);
+    bench_box_end(stream, boxes[0], true);
+}
+
+static void bench_generate(bench_stream_t *stream)
+{
+    uint8_t  *boxes[4]  = {};
+    uint64_t  wallclock = current_time_milliseconds() * 1000;
+    size_t    fragment  = 0;
+    size_t    sample    = 0;
+    size_t    mdat_size = 0;
+
+    /* Initialization segment */
+    boxes[0] = bench_box_begin(stream, "ftyp");
+    bench_put32(stream, 0x69736f36); // iso6
+    bench_put32(stream, 0);
+    bench_box_end(stream, boxes[0], true);
+    bench_generate_moov(stream);
+    stream->init_count = stream->count;
+
+    for (fragment = 0; fragment < BENCH_FRAGMENTS; fragment++)
+    {
+        /* Wallclock box */
+        boxes[0] = bench_box_begin(stream, "egwc");
+        bench_put64(stream, wallclock + fragment * 1000000);
+        bench_box_end(stream, boxes[0], true);
+
+        /* Movie fragment, one video track fragment */
+        boxes[0] = bench_box_begin(stream, "moof");
+        boxes[1] = bench_box_begin(stream, "mfhd");
+        bench_put32(stream, 0);
+        bench_put32(stream, fragment + 1);
+        bench_box_end(stream, boxes[1], false);
+        boxes[1] = bench_box_begin(stream, "traf");
+        boxes[2] = bench_box_begin(stream, "tfhd");
+        bench_put32(stream, 0x020000);
+        bench_put32(stream, 1);
+        bench_box_end(stream, boxes[2], false);
+        boxes[2] = bench_box_begin(stream, "tfdt");
+        bench_put32(stream, 0x01000000);
+        stream->decode_times[fragment] = stream->buffer + stream->length;
+        bench_put64(stream, fragment * BENCH_SAMPLES * BENCH_DURATION);
+        bench_box_end(stream, boxes[2], false);
+        boxes[2] = bench_box_begin(stream, "trun");
+        bench_put32(stream, 0x000701);
+        bench_put32(stream, BENCH_SAMPLES);
+        bench_put32(stream, 0);
+        for (mdat_size = 0, sample = 0; sample < BENCH_SAMPLES; sample++)
+        {
+            bench_put32(stream, BENCH_DURATION);
+            bench_put32(stream, 1000 + sample);
+            bench_put32(stream, sample ? 0x00010000 : 0x02000000);
+            mdat_size += 1000 + sample;
+        }
+        bench_box_end(stream, boxes[2], false);
+        bench_box_end(stream, boxes[1], false);
+        bench_box_end(stream, boxes[0], true);
+
+        /* Media data */
+        boxes[0] = bench_box_begin(stream, "mdat");
+        stream->length += mdat_size;
+        bench_box_end(stream, boxes[0], true);
+    }
+}
+
+static void bench_advance(bench_stream_t *stream)
+{
+    uint64_t decode_time = 0;
+    uint32_t word        = 0;
+    size_t   fragment    = 0;
+
+    /* Next round continues the media timeline, rather than jumping back */
+    for (fragment = 0; fragment < BENCH_FRAGMENTS; fragment++)
+    {
+        decode_time = box_get64(stream->decode_times[fragment]) +
+            BENCH_FRAGMENTS * BENCH_SAMPLES * BENCH_DURATION;
+        word = htonl((uint32_t)(decode_time >> 32));
+        memcpy(stream->decode_times[fragment], &word, sizeof(word));
+        word = htonl((uint32_t)(decode_time));
+        memcpy(stream->decode_times[fragment] + 4, &word, sizeof(word));
+    }
+}
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts = {};
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)(ts.tv_sec) * 1000000000ULL + (uint64_t)(ts.tv_nsec);
+}
+
@@ -0,0 +1,75 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   metric_pipeline.c
+ * Desc:   Statically dispatched metric pipeline for a fixed metric set
+ */
+
+#include "metric.h"
+
+/* Defines METRIC_PIPELINE(X) listing chosen metrics, generated at build */
+#include "metric_pipeline_list.h"
+
+/* Entry points defined by REGISTER_METRIC() & context slot of each metric */
+#define METRIC_PIPELINE_DECLARE(metric) \
+    extern const metric_t *const metric_static_##metric; \
+    bool metric_static_emit_##metric(metric_context_t ctx, \
+            const fmp4_box_t *box, error_context_t *errctx); \
+    static size_t metric_slot_##metric = 0;
+
+#define METRIC_PIPELINE_BIND(metric) \
+    if (!metric_pipeline_slot(metric_static_##metric, &metric_slot_##metric)) \
+    { \
+        fprintf(stderr, "Compiled-in metric %s is not configured\n", \
+                metric_static_##metric->envname); \
+        error_save_retval(errctx, ENOENT, false); \
+    } \
+    ++count;
+
+#define METRIC_PIPELINE_EMIT(metric) \
+    if (!metric_static_emit_##metric( \
+                metric_contexts[metric_slot_##metric], box, errctx)) \
+        return false;
+
+METRIC_PIPELINE(METRIC_PIPELINE_DECLARE)
+
+static bool metric_pipeline_slot(const metric_t *metric, size_t *slot);
+
+bool metrics_pipeline_bind(error_context_t *errctx)
+{
+    size_t count = 0;
+
+    /* Every compiled-in metric must be configured, and nothing else */
+    METRIC_PIPELINE(METRIC_PIPELINE_BIND)
+    error_save_retval_if(count != registered_count, errctx, EINVAL, false);
+
+    return true;
+}
+
+bool
+metrics_pipeline_feed(metric_context_t *metric_contexts,
+                      const fmp4_box_t  *box,
+                      error_context_t  *errctx)
+{
+    /* Direct calls, allowing LTO to inline every emit body here */
+    METRIC_PIPELINE(METRIC_PIPELINE_EMIT)
+
+    return true;
+}
+
+static bool metric_pipeline_slot(const metric_t *metric, size_t *slot)
+{
+    size_t idx = 0;
+
+    for (idx = 0; idx < registered_count; idx++)
+    {
+        if (metrics_registry[idx] == metric)
+        {
+            *slot = idx;
+            return true;
+        }
+    }
+
+    return false;
+}
+
@@ -0,0 +1,292 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   metric_table.c
+ * Desc:   Shared-memory table of latest metric values implementation
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "metric_table.h"
+
+#define METRIC_TABLE_MAX_CAPACITY (1024 * 1024)
+#define METRIC_TABLE_READ_RETRIES 64
+#define METRIC_TABLE_MAX_PROBES   16
+
+/* Table published to by this process, unmapped if disabled */
+static metric_table_t table = {};
+
+static bool metric_table_create(metric_table_t *table, const char *path,
+        size_t capacity, error_context_t *errctx);
+static bool metric_table_valid(const metric_table_t *table);
+
+bool metric_table_init(error_context_t *errctx)
+{
+    const char *config   = NULL;
+    const char *comma    = NULL;
+    char        path[PATH_MAX] = {0};
+    uint64_t    capacity = 0;
+    int         ret      = -1;
+
+    /* Table is optional, stay disabled if not configured */
+    config = getenv(METRIC_TABLE_ENVNAME);
+    if (!config)
+        return true;
+
+    /* Extract configuration values */
+    comma = strchr(config, ',');
+    error_save_retval_if(!comma, errctx, EINVAL, false);
+    ret = snprintf(path, sizeof(path), "%.*s", (int)(comma - config), config);
+    error_save_retval_if(ret <= 0 || ret >= sizeof(path), errctx, EINVAL, false);
+    capacity = strtoull(comma + 1, NULL, 10);
+    error_save_retval_if(capacity == 0 || capacity > METRIC_TABLE_MAX_CAPACITY,
+            errctx, EINVAL, false);
+
+    return metric_table_create(&table, path, capacity, errctx);
+}
+
+void
+metric_table_publish(uint64_t    stream_id,
+                     uint64_t    metric_id,
+                     const char *path,
+                     double      value,
+                     uint64_t    timestamp_ms)
+{
+    metric_table_slot_t *slot     = NULL;
+    uint64_t             expected = 0;
+    uint32_t             capacity = 0;
+    uint32_t             probes   = 0;
+    uint32_t             sequence = 0;
+    uint32_t             probe    = 0;
+
+    /* Nothing to do if table is disabled */
+    if (!table.header || !path)
+        return;
+
+    /* Zero marks unclaimed slots */
+    if (metric_id == 0)
+        metric_id = 1;
+
+    /* Find slot owned by metric, or claim first free one on short probe path */
+    capacity = table.header->capacity;
+    probes = MIN(capacity, METRIC_TABLE_MAX_PROBES);
+    for (probe = 0; probe < probes; probe++)
+    {
+        slot = &(table.slots[(metric_id + probe) % capacity]);
+        expected = __atomic_load_n(&(slot->metric_id), __ATOMIC_ACQUIRE);
+        if (expected == metric_id)
+            break;
+        if (expected == 0 && (__atomic_compare_exchange_n(&(slot->metric_id),
+                    &expected, metric_id, false, __ATOMIC_ACQ_REL,
+                    __ATOMIC_ACQUIRE) || expected == metric_id))
+            break;
+    }
+    if (unlikely(probe == probes))
+        return; // probe path full, drop value
+
+    /* Enter write section, making sequence odd */
+    sequence = __atomic_load_n(&(slot->sequence), __ATOMIC_RELAXED);
+    do
+    {
+        if (sequence & 1)
+            sequence = __atomic_load_n(&(slot->sequence), __ATOMIC_RELAXED);
+    }
+    while ((sequence & 1) || !__atomic_compare_exchange_n(&(slot->sequence),
+                &sequence, sequence + 1, true, __ATOMIC_ACQUIRE,
+                __ATOMIC_RELAXED));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    /* Update slot payload */
+    slot->stream_id = stream_id;
+    slot->value = value;
+    slot->timestamp_ms = timestamp_ms;
+    NULL_TERM_STRNCPY(slot->path, path, sizeof(slot->path));
+
+    /* Leave write section, making sequence even again */
+    __atomic_store_n(&(slot->sequence), sequence + 2, __ATOMIC_RELEASE);
+}
+
+void metric_table_fini(void)
+{
+    metric_table_unmap(&table);
+}
+
+bool
+metric_table_map(metric_table_t  *table,
+                 const char      *path,
+                 bool             writable,
+                 error_context_t *errctx)
+{
+    struct stat st     = {};
+    int         fd     = -1;
+    int         ret    = -1;
+    bool        result = false;
+
+    /* Sanity checks */
+    if (!table || !path || !errctx)
+        error_save_jump(errctx, EINVAL, CLEANUP);
+
+    /* Map whole existing table file */
+    fd = open(path, writable ? O_RDWR : O_RDONLY);
+    error_save_jump_if(fd < 0, errctx, errno, CLEANUP);
+    ret = fstat(fd, &st);
+    error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+    error_save_jump_if(st.st_size < sizeof(metric_table_header_t),
+            errctx, EBADF, CLEANUP);
+    table->size = st.st_size;
+    table->header = (metric_table_header_t *)(mmap(NULL, table->size,
+                PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0));
+    if (table->header == MAP_FAILED)
+    {
+        table->header = NULL;
+        error_save_jump(errctx, errno, CLEANUP);
+    }
+    table->slots = (metric_table_slot_t *)(table->header + 1);
+
+    /* Validate table layout */
+    error_save_jump_if(!metric_table_valid(table), errctx, EBADF, CLEANUP);
+
+    result = true;
+
+CLEANUP:
+
+    if (fd >= 0)
+        close(fd);
+    if (!result)
+        metric_table_unmap(table);
+
+    return result;
+}
+
+bool
+metric_table_snapshot(const metric_table_t *table,
+                      size_t                idx,
+                      metric_table_slot_t  *slot)
+{
+    const metric_table_slot_t *shared = NULL;
+    uint32_t                   begin  = 0;
+    uint32_t                   end    = 0;
+    size_t                     tries  = 0;
+
+    /* Sanity checks */
+    if (!table || !table->header || !slot || idx >= table->header->capacity)
+        return false;
+
+    /* Copy slot until no writer interfered with the copy */
+    shared = &(table->slots[idx]);
+    for (tries = 0; tries < METRIC_TABLE_READ_RETRIES; tries++)
+    {
+        begin = __atomic_load_n(&(shared->sequence), __ATOMIC_ACQUIRE);
+        if (begin == 0)
+            return false; // never published
+        if (begin & 1)
+            continue;
+        memcpy(slot, shared, sizeof(*slot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&(shared->sequence), __ATOMIC_RELAXED);
+        if (begin == end)
+        {
+            slot->path[sizeof(slot->path) - 1] = '\0';
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void metric_table_unmap(metric_table_t *table)
+{
+    /* Sanity checks */
+    if (!table || !table->header)
+        return;
+
+    (void)munmap(table->header, table->size);
+    table->header = NULL;
+    table->slots = NULL;
+    table->size = 0;
+}
+
+static bool
+metric_table_create(metric_table_t  *table,
+                    const char      *path,
+                    size_t           capacity,
+                    error_context_t *errctx)
+{
+    struct stat st     = {};
+    size_t      size   = 0;
+    int         fd     = -1;
+    int         ret    = -1;
+    bool        result = false;
+
+    /* Open or create table file, serializing initialization across daemons */
+    size = sizeof(metric_table_header_t) + capacity * sizeof(metric_table_slot_t);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    error_save_jump_if(fd < 0, errctx, errno, CLEANUP);
+    ret = flock(fd, LOCK_EX);
+    error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+    ret = fstat(fd, &st);
+    error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+
+    /* Size & map file, initializing header only for new tables */
+    if (st.st_size == 0)
+    {
+        ret = ftruncate(fd, size);
+        error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+        st.st_size = size;
+    }
+    table->size = st.st_size;
+    table->header = (metric_table_header_t *)(mmap(NULL, table->size,
+                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    if (table->header == MAP_FAILED)
+    {
+        table->header = NULL;
+        error_save_jump(errctx, errno, CLEANUP);
+    }
+    table->slots = (metric_table_slot_t *)(table->header + 1);
+    if (table->header->magic == 0)
+    {
+        table->header->version = METRIC_TABLE_VERSION;
+        table->header->capacity = capacity;
+        table->header->slot_size = sizeof(metric_table_slot_t);
+        table->header->created_ms = current_time_milliseconds();
+        __atomic_store_n(&(table->header->magic), METRIC_TABLE_MAGIC,
+                __ATOMIC_RELEASE);
+    }
+
+    /* Existing tables must share our layout */
+    error_save_jump_if(!metric_table_valid(table), errctx, EBADF, CLEANUP);
+
+    result = true;
+
+CLEANUP:
+
+    if (fd >= 0)
+        close(fd); // also releases lock
+    if (!result)
+        metric_table_unmap(table);
+
+    return result;
+}
+
+static bool metric_table_valid(const metric_table_t *table)
+{
+    const metric_table_header_t *header = table->header;
+
+    if (__atomic_load_n(&(header->magic), __ATOMIC_ACQUIRE) != METRIC_TABLE_MAGIC)
+        return false;
+    if (header->version != METRIC_TABLE_VERSION)
+        return false;
+    if (header->slot_size != sizeof(metric_table_slot_t))
+        return false;
+    if (header->capacity == 0 || table->size < sizeof(*header) +
+            (size_t)(header->capacity) * sizeof(metric_table_slot_t))
+        return false;
+
+    return true;
+}
+
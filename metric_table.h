@@ -0,0 +1,83 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   metric_table.h
+ * Desc:   Shared-memory table of latest metric values header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Environment variable holding "<file path>,<slot capacity>" */
+    #define METRIC_TABLE_ENVNAME "METRIC_TABLE"
+
+    /* Table file layout identification */
+    #define METRIC_TABLE_MAGIC   0x544d3446 // "F4MT"
+    #define METRIC_TABLE_VERSION 1
+
+    /* Maximum length of metric path kept per slot */
+    #define METRIC_TABLE_PATH_LEN 88
+
+    /* Fixed-size table header, followed by capacity slots */
+    typedef struct metric_table_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t capacity;
+        uint32_t slot_size;
+        uint64_t created_ms;
+        uint8_t  reserved[40];
+
+    } metric_table_header_t;
+
+    /* Seqlock-protected slot, sequence is odd while a writer is updating */
+    typedef struct metric_table_slot_t
+    {
+        uint32_t sequence;
+        uint32_t reserved;
+        uint64_t stream_id;
+        uint64_t metric_id;  // path hash mixed with stream id, 0 if unclaimed
+        double   value;
+        uint64_t timestamp_ms;
+        char     path[METRIC_TABLE_PATH_LEN];
+
+    } metric_table_slot_t;
+
+    /* Memory-mapped table file */
+    typedef struct metric_table_t
+    {
+        metric_table_header_t *header;
+        metric_table_slot_t   *slots;
+        size_t                 size;
+
+    } metric_table_t;
+
+    /* Writer side, used by the daemon's metric output path */
+    bool metric_table_init(error_context_t *errctx);
+    void metric_table_publish(uint64_t stream_id, uint64_t metric_id,
+            const char *path, double value, uint64_t timestamp_ms);
+    void metric_table_fini(void);
+
+    /* Reader side, maps an existing table & takes consistent slot snapshots */
+    bool metric_table_map(metric_table_t *table, const char *path,
+            bool writable, error_context_t *errctx);
+    bool metric_table_snapshot(const metric_table_t *table, size_t idx,
+            metric_table_slot_t *slot);
+    void metric_table_unmap(metric_table_t *table);
+
+#ifdef __cplusplus
+}
+#endif
+
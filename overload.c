@@ -0,0 +1,106 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   overload.c
+ * Desc:   Overload protection by stream priority implementation
+ */
+
+#include <inttypes.h>
+
+#include "metric.h"
+#include "overload.h"
+
+/* Degradation state, level is read by every stream worker */
+static struct
+{
+    uint64_t          lag_ms;        // threshold, 0 if disabled
+    uint32_t          sampling;
+    uint64_t          max_lag_ms;    // within interval
+    uint64_t          prev_time_ms;
+    volatile uint32_t level;
+
+} overload = {};
+
+/* Level & lag output, interval is the period levels are adjusted at */
+static metric_t overload_metric =
+{
+    .envname = OVERLOAD_ENVNAME,
+};
+
+bool overload_init(error_context_t *errctx)
+{
+    char *comma = NULL;
+
+    /* Overload protection is optional */
+    if (!metric_config(&overload_metric))
+        return true;
+
+    /* Parse options, absent ones keep their defaults */
+    overload.lag_ms = OVERLOAD_LAG_MS;
+    overload.sampling = OVERLOAD_SAMPLING;
+    if (overload_metric.options[0])
+    {
+        overload.lag_ms = strtoull(overload_metric.options, &comma, 10);
+        if (*comma == ',')
+            overload.sampling = (uint32_t)(strtoul(comma + 1, NULL, 10));
+    }
+    error_save_retval_if(overload.lag_ms == 0 ||
+            overload.lag_ms == ULLONG_MAX || overload.sampling < 2, errctx,
+            EINVAL, false);
+
+    return true;
+}
+
+void overload_update(uint64_t lag_ms, uint64_t now_ms)
+{
+    error_context_t  _errctx = {};
+    error_context_t *errctx  = &_errctx;
+
+    /* Nothing to do if protection is disabled */
+    if (!overload.lag_ms)
+        return;
+
+    /* Check if we are at the end of an interval time frame */
+    overload.max_lag_ms = MAX(overload.max_lag_ms, lag_ms);
+    if (overload.prev_time_ms == 0)
+        overload.prev_time_ms = now_ms;
+    if (now_ms - overload.prev_time_ms < overload_metric.interval_ms)
+        return;
+    overload.prev_time_ms = now_ms;
+
+    /* Degrade one more step while lagging, recover once well below */
+    if (overload.max_lag_ms >= overload.lag_ms)
+        overload.level = MIN(overload.level + 1, OVERLOAD_MAX_LEVEL);
+    else if (overload.max_lag_ms < overload.lag_ms / 2 && overload.level)
+        --(overload.level);
+
+    /* Output level & worst lag, attributed to no stream */
+    metrics_bind_stream(NULL);
+    if (!metric_output(&overload_metric, ".level", overload.level, 0, now_ms,
+                errctx) ||
+            !metric_output(&overload_metric, ".lag_ms", overload.max_lag_ms, 0,
+                now_ms, errctx))
+        error_log_saved(errctx);
+    overload.max_lag_ms = 0;
+}
+
+overload_mode_t overload_mode(uint32_t priority)
+{
+    int64_t steps = 0;
+
+    /* Highest priority is kept exact whatever the level */
+    if (priority == 0)
+        return OVERLOAD_EXACT;
+
+    /* Lowest priority is sampled from the first level, the next one on... */
+    steps = (int64_t)(overload.level) + MIN(priority, OVERLOAD_PRIORITIES - 1) -
+        (OVERLOAD_PRIORITIES - 1);
+
+    return steps > 0 ? OVERLOAD_SAMPLED : OVERLOAD_EXACT;
+}
+
+uint32_t overload_sampling(void)
+{
+    return overload.sampling;
+}
+
@@ -0,0 +1,56 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   overload.h
+ * Desc:   Overload protection by stream priority header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Environment variable holding "<path>,<interval>[,<lag ms>[,<1 in N>]]" */
+    #define OVERLOAD_ENVNAME          "OVERLOAD"
+
+    /* Defaults of loop lag threshold & fragment sampling */
+    #define OVERLOAD_LAG_MS           100
+    #define OVERLOAD_SAMPLING         4
+
+    /*
+     * Stream priorities, 0 is never degraded & higher ones are shed first;
+     * each degradation level moves one more priority from exact processing
+     * to sampled, lowest priorities first
+     */
+    #define OVERLOAD_PRIORITIES       4
+    #define OVERLOAD_DEFAULT_PRIORITY 1
+    #define OVERLOAD_MAX_LEVEL        (OVERLOAD_PRIORITIES - 1)
+
+    /* Processing of a stream's fragments */
+    typedef enum overload_mode_t
+    {
+        OVERLOAD_EXACT,    // every fragment fed to metrics
+        OVERLOAD_SAMPLED,  // 1 in N fragments only, counts scaled by N
+
+    } overload_mode_t;
+
+    /* Exported public functions */
+    bool overload_init(error_context_t *errctx);
+    void overload_update(uint64_t lag_ms, uint64_t now_ms);
+    overload_mode_t overload_mode(uint32_t priority);
+    uint32_t overload_sampling(void);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,249 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   player_buffer.c
+ * Desc:   FMP4 stream virtual player buffer & stall metric
+ */
+
+#include <fmp4.h>
+#include <inttypes.h>
+
+#include "error.h"
+#include "metric.h"
+
+/* Defaults of player model options */
+#define PLAYER_STARTUP_MS 1000 // buffered media needed to (re)start playback
+#define PLAYER_TARGET_MS  0    // live latency caught up to, 0 for none
+
+/*
+ * Per-track virtual player, media buffered is media received less media
+ * played; both are kept as totals so that rounding never accumulates
+ */
+typedef struct player_t
+{
+    uint64_t media_units;   // received, in track timescale
+    uint64_t played_ms;     // media played or skipped
+    uint64_t update_ms;     // wallclock played up to
+    bool     started;
+    bool     playing;
+    uint32_t stalls;        // started within interval
+    uint64_t stall_ms;      // stalled within interval
+
+} player_t;
+
+/* Internal metric context */
+typedef struct context_t
+{
+    uint64_t prev_time_ms;
+    uint32_t generation;    // of track table slots below
+    player_t players[MAX_TRACKS];
+
+} context_t;
+
+static bool player_buffer_configure(const char *options,
+        error_context_t *errctx);
+static metric_context_t player_buffer_context(error_context_t *errctx);
+static bool player_buffer_emit(metric_context_t ctx, const fmp4_box_t *box,
+        error_context_t *errctx);
+static void player_buffer_play(player_t *player, const track_t *track,
+        uint64_t now_ms);
+static void player_buffer_feed(player_t *player, const track_t *track,
+        uint64_t units, uint64_t now_ms);
+static bool player_buffer_output(player_t *player, const track_t *track,
+        uint64_t now_ms, error_context_t *errctx);
+
+static metric_t player_buffer =
+{
+    .envname   = "PLAYER_BUFFER",
+    .masks     = METRIC_MASK_AUDIO | METRIC_MASK_VIDEO,
+    .context   = player_buffer_context,
+    .emit      = player_buffer_emit,
+    .configure = player_buffer_configure,
+};
+
+REGISTER_METRIC(player_buffer);
+
+/* Player model options, "<startup ms>,<target latency ms>" after interval */
+static uint64_t startup_ms = PLAYER_STARTUP_MS;
+static uint64_t target_ms  = PLAYER_TARGET_MS;
+
+static bool
+player_buffer_configure(const char      *options,
+                        error_context_t *errctx)
+{
+    char *comma = NULL;
+
+    /* Parse options, absent ones keep their defaults */
+    if (options[0])
+    {
+        startup_ms = strtoull(options, &comma, 10);
+        if (*comma == ',')
+            target_ms = strtoull(comma + 1, NULL, 10);
+        error_save_retval_if(startup_ms == ULLONG_MAX ||
+                target_ms == ULLONG_MAX ||
+                (target_ms && target_ms < startup_ms), errctx, EINVAL, false);
+    }
+
+    return true;
+}
+
+static metric_context_t
+player_buffer_context(error_context_t *errctx)
+{
+    context_t *ctx = NULL;
+
+    ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    error_save_retval_if(!ctx, errctx, errno, NULL);
+    return (metric_context_t)(ctx);
+}
+
+static bool
+player_buffer_emit(metric_context_t  ctx,
+                   const fmp4_box_t  *box,
+                   error_context_t  *errctx)
+{
+    context_t              *metric_ctx = NULL;
+    const track_table_t    *tracks     = NULL;
+    const fragment_t       *fragment   = NULL;
+    const fragment_track_t *traf       = NULL;
+    uint64_t                now_ms     = 0;
+    size_t                  idx        = 0;
+    int                     slot       = -1;
+
+    /* Sanity checks */
+    if (!ctx || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast context to internal metric context */
+    metric_ctx = (context_t *)(ctx);
+
+    /* Media is buffered a fragment at a time */
+    switch (ntohl(box->type))
+    {
+        case 0x6d6f6f66: break; // moof box
+        default: return true;
+    }
+
+    /* Initialize tracking timestamps, starting over on new tracks */
+    now_ms = metrics_now_ms();
+    if (metric_ctx->prev_time_ms == 0)
+        metric_ctx->prev_time_ms = now_ms;
+    tracks = metrics_tracks();
+    if (metric_ctx->generation != tracks->generation)
+    {
+        memset(metric_ctx->players, 0, sizeof(metric_ctx->players));
+        metric_ctx->generation = tracks->generation;
+    }
+
+    /* Buffer sample durations of every track in fragment, or fragments */
+    fragment = metrics_fragment();
+    for (idx = 0; idx < fragment->track_count; idx++)
+    {
+        traf = &(fragment->tracks[idx]);
+        slot = track_table_slot(tracks, traf->track_id);
+        if (slot >= 0 && tracks->tracks[slot].timescale)
+            player_buffer_feed(&(metric_ctx->players[slot]),
+                    &(tracks->tracks[slot]), traf->duration * metrics_weight(),
+                    now_ms);
+    }
+
+    /* Check if we are at the end of an interval time frame */
+    if (now_ms - metric_ctx->prev_time_ms < player_buffer.interval_ms)
+        return true;
+    for (idx = 0; idx < tracks->count; idx++)
+    {
+        if (tracks->tracks[idx].timescale &&
+                !player_buffer_output(&(metric_ctx->players[idx]),
+                    &(tracks->tracks[idx]), now_ms, errctx))
+            return false;
+    }
+    metric_ctx->prev_time_ms = now_ms;
+
+    return true;
+}
+
+static void
+player_buffer_play(player_t      *player,
+                   const track_t *track,
+                   uint64_t       now_ms)
+{
+    uint64_t media_ms   = track_to_ms(track, player->media_units);
+    uint64_t buffer_ms  = media_ms - player->played_ms;
+    uint64_t elapsed_ms = 0;
+
+    /* Wallclock since last update drains buffer while playing */
+    if (player->update_ms && now_ms > player->update_ms)
+        elapsed_ms = now_ms - player->update_ms;
+    player->update_ms = MAX(player->update_ms, now_ms);
+
+    if (player->playing && elapsed_ms > buffer_ms)
+    {
+        /* Buffer ran dry, stalled for the remainder */
+        player->played_ms = media_ms;
+        player->playing = false;
+        player->stall_ms += elapsed_ms - buffer_ms;
+        ++(player->stalls);
+    }
+    else if (player->playing)
+        player->played_ms += elapsed_ms;
+    else if (player->started)
+        player->stall_ms += elapsed_ms;
+}
+
+static void
+player_buffer_feed(player_t      *player,
+                   const track_t *track,
+                   uint64_t       units,
+                   uint64_t       now_ms)
+{
+    uint64_t media_ms  = 0;
+    uint64_t buffer_ms = 0;
+
+    /* Play up to arrival, then buffer fragment */
+    player_buffer_play(player, track, now_ms);
+    player->media_units += units;
+    media_ms = track_to_ms(track, player->media_units);
+    buffer_ms = media_ms - player->played_ms;
+
+    /* (Re)start playback once enough is buffered */
+    if (!player->playing && buffer_ms >= startup_ms)
+        player->playing = player->started = true;
+
+    /* Players holding a target latency skip ahead when buffer exceeds it */
+    if (player->playing && target_ms && buffer_ms > target_ms)
+        player->played_ms = media_ms - target_ms;
+}
+
+static bool
+player_buffer_output(player_t        *player,
+                     const track_t   *track,
+                     uint64_t         now_ms,
+                     error_context_t *errctx)
+{
+    char     series[MAX_TRACK_SERIES_LEN + sizeof(".stall_ms")] = {0};
+    uint64_t level_ms                                         = 0;
+
+    /* Play up to now, stalls in progress count up to now */
+    player_buffer_play(player, track, now_ms);
+    level_ms = track_to_ms(track, player->media_units) - player->played_ms;
+
+    /* Output buffer level, stalls started & time stalled within interval */
+    (void)snprintf(series, sizeof(series), "%s.level", track->series);
+    if (!metric_output(&player_buffer, series, level_ms, 0, now_ms, errctx))
+        return false;
+    (void)snprintf(series, sizeof(series), "%s.stalls", track->series);
+    if (!metric_output(&player_buffer, series, player->stalls, 0, now_ms,
+                errctx))
+        return false;
+    (void)snprintf(series, sizeof(series), "%s.stall_ms", track->series);
+    if (!metric_output(&player_buffer, series, player->stall_ms, 0, now_ms,
+                errctx))
+        return false;
+
+    /* Reset interval aggregates */
+    player->stalls = 0;
+    player->stall_ms = 0;
+
+    return true;
+}
+
@@ -18,28 +18,50 @@ typedef struct context_t
     uint64_t prev_time_ms;
     uint64_t cumulative_latency_ms;
     size_t   samples;
+    window_t windows[];     // window_count of them
 
 } context_t;
 
+static bool q2q_wallclock_latency_configure(const char *options,
+        error_context_t *errctx);
 static metric_context_t q2q_wallclock_latency_context(error_context_t *errctx);
 static bool q2q_wallclock_latency_emit(metric_context_t ctx,
         const fmp4_box_t *box, error_context_t *errctx);
 
 static metric_t q2q_wallclock_latency =
 {
-    .envname = "QUEUE_TO_QUEUE_WALLCLOCK_LATENCY",
-    .masks   = METRIC_MASK_SCRIPT,
-    .context = q2q_wallclock_latency_context,
-    .emit    = q2q_wallclock_latency_emit,
+    .envname   = "QUEUE_TO_QUEUE_WALLCLOCK_LATENCY",
+    .masks     = METRIC_MASK_SCRIPT,
+    .context   = q2q_wallclock_latency_context,
+    .emit      = q2q_wallclock_latency_emit,
+    .configure = q2q_wallclock_latency_configure,
 };
 
 REGISTER_METRIC(q2q_wallclock_latency);
 
+/* Extra sliding & EWMA windows, same for every stream */
+static window_spec_t window_specs[MAX_WINDOWS] = {};
+static size_t        window_count              = 0;
+
+static bool
+q2q_wallclock_latency_configure(const char      *options,
+                                error_context_t *errctx)
+{
+    window_count = window_parse(options, window_specs, MAX_WINDOWS, errctx);
+    return window_count != SIZE_MAX;
+}
+
 static metric_context_t
 q2q_wallclock_latency_context(error_context_t *errctx)
 {
-    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    context_t *ctx = NULL;
+    size_t     idx = 0;
+
+    ctx = (context_t *)(calloc(1, sizeof(context_t) +
+                window_count * sizeof(window_t)));
     error_save_retval_if(!ctx, errctx, errno, NULL);
+    for (idx = 0; idx < window_count; idx++)
+        window_init(&(ctx->windows[idx]), &(window_specs[idx]));
     return (metric_context_t)(ctx);
 }
 
@@ -53,7 +75,7 @@ q2q_wallclock_latency_emit(metric_context_t  ctx,
     uint64_t   stream_ms  = 0;
     uint64_t   average_ms = 0;
     uint64_t   diff_ms    = 0;
-    int        ret        = -1;
+    size_t     idx        = 0;
 
     /* Sanity checks */
     if (!ctx || !box || !errctx)
@@ -70,12 +92,16 @@ q2q_wallclock_latency_emit(metric_context_t  ctx,
     }
 
     /* Extract wallclock timestamp, omit overflow samples due to clock skew */
-    now_ms = current_time_milliseconds();
+    now_ms = metrics_now_ms();
     stream_ms = fmp4_parse_wallclock(box->body,
             ntohl(box->size), errctx) / 1000;
     if (now_ms < stream_ms || stream_ms == 0)
         return true;
 
+    /* Windows see every sample, warmup only applies to intervals */
+    for (idx = 0; idx < window_count; idx++)
+        window_add(&(metric_ctx->windows[idx]), now_ms, now_ms - stream_ms);
+
     /* Check if we're still within warmup period */
     if (metric_ctx->init_time_ms == 0)
         metric_ctx->init_time_ms = metric_ctx->prev_time_ms = now_ms;
@@ -95,9 +121,13 @@ q2q_wallclock_latency_emit(metric_context_t  ctx,
         metric_ctx->cumulative_latency_ms = 0;
         metric_ctx->samples = 0;
         metric_ctx->prev_time_ms = now_ms;
-        ret = printf("%s %" PRIu64 " %" PRIu64 "\n", q2q_wallclock_latency.path,
-                average_ms, now_ms / 1000);
-        error_save_retval_if(ret < 0, errctx, errno, false);
+        if (!metric_output(&q2q_wallclock_latency, "", average_ms, 0, now_ms,
+                    errctx))
+            return false;
+        if (!metric_output_windows(&q2q_wallclock_latency, "",
+                    metric_ctx->windows, window_count, false, 1, 0, now_ms,
+                    errctx))
+            return false;
     }
 
     return true;
@@ -0,0 +1,211 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   sink.c
+ * Desc:   Metric sink output with disk-backed outage spool implementation
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "metric.h"
+#include "sink.h"
+
+/* Spool of lines the sink missed, unmapped if disabled */
+static struct
+{
+    sink_spool_header_t *header;
+    char                *data;
+    size_t               size;
+    uint64_t             backfill_kbps;
+    uint64_t             backfill_ms;  // time budget was last granted
+    int                  fd;           // kept open to hold file lock
+    pthread_mutex_t      lock;         // appends & offset resets
+
+} spool = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static bool sink_spool_append(const char *line, size_t length);
+
+bool sink_init(error_context_t *errctx)
+{
+    const char  *config   = NULL;
+    const char  *comma    = NULL;
+    char        *end      = NULL;
+    char         path[PATH_MAX] = {0};
+    struct stat  st       = {};
+    uint64_t     capacity = 0;
+    int          fd       = -1;
+    int          ret      = -1;
+    bool         result   = false;
+
+    /* Spool is optional, lines are lost during outages if not configured */
+    config = getenv(SINK_SPOOL_ENVNAME);
+    if (!config)
+        return true;
+
+    /* Extract configuration values */
+    comma = strchr(config, ',');
+    error_save_jump_if(!comma, errctx, EINVAL, CLEANUP);
+    ret = snprintf(path, sizeof(path), "%.*s", (int)(comma - config), config);
+    error_save_jump_if(ret <= 0 || ret >= sizeof(path), errctx, EINVAL, CLEANUP);
+    capacity = strtoull(comma + 1, &end, 10);
+    error_save_jump_if(capacity == 0 || capacity > SINK_SPOOL_MAX_MB,
+            errctx, EINVAL, CLEANUP);
+    capacity *= 1024 * 1024;
+    spool.backfill_kbps = SINK_BACKFILL_KBPS;
+    if (*end == ',')
+        spool.backfill_kbps = strtoull(end + 1, NULL, 10);
+    error_save_jump_if(spool.backfill_kbps == 0 ||
+            spool.backfill_kbps == ULLONG_MAX, errctx, EINVAL, CLEANUP);
+
+    /* Open or create spool, one daemon at a time owns it */
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    error_save_jump_if(fd < 0, errctx, errno, CLEANUP);
+    ret = flock(fd, LOCK_EX | LOCK_NB);
+    error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+    ret = fstat(fd, &st);
+    error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+
+    /* Size & map file, keeping lines left over by a previous run */
+    spool.size = sizeof(sink_spool_header_t) + capacity;
+    if (st.st_size != spool.size)
+    {
+        ret = ftruncate(fd, 0);
+        error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+        ret = ftruncate(fd, spool.size);
+        error_save_jump_if(ret < 0, errctx, errno, CLEANUP);
+    }
+    spool.header = (sink_spool_header_t *)(mmap(NULL, spool.size,
+                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    if (spool.header == MAP_FAILED)
+    {
+        spool.header = NULL;
+        error_save_jump(errctx, errno, CLEANUP);
+    }
+    spool.data = (char *)(spool.header + 1);
+    if (spool.header->magic != SINK_SPOOL_MAGIC ||
+            spool.header->version != SINK_SPOOL_VERSION ||
+            spool.header->capacity != capacity ||
+            spool.header->head > spool.header->tail ||
+            spool.header->tail > capacity)
+    {
+        memset(spool.header, 0, sizeof(*(spool.header)));
+        spool.header->magic = SINK_SPOOL_MAGIC;
+        spool.header->version = SINK_SPOOL_VERSION;
+        spool.header->capacity = capacity;
+    }
+
+    spool.fd = fd;
+    fd = -1;
+    result = true;
+
+CLEANUP:
+
+    if (fd >= 0)
+        close(fd);
+    if (!result)
+        sink_fini();
+
+    return result;
+}
+
+bool sink_write(const char *line, size_t length)
+{
+    /* Spool while sink is down, and whatever fails to reach it */
+    if (spool.header && metrics_output_failed)
+        return sink_spool_append(line, length);
+    if (fwrite(line, length, 1, stdout) == 1 && !ferror(stdout))
+        return true;
+    metrics_output_failed = true;
+
+    return spool.header ? sink_spool_append(line, length) : false;
+}
+
+void sink_backfill(uint64_t now_ms)
+{
+    const char *begin  = NULL;
+    const char *end    = NULL;
+    uint64_t    head   = 0;
+    uint64_t    tail   = 0;
+    uint64_t    budget = 0;
+
+    /* Nothing to do if spool is disabled or sink is down */
+    if (!spool.header || metrics_output_failed)
+    {
+        spool.backfill_ms = 0;
+        return;
+    }
+
+    /* Pace by bytes granted since last call, at most a second's worth */
+    if (spool.backfill_ms == 0 || now_ms <= spool.backfill_ms)
+    {
+        spool.backfill_ms = now_ms;
+        return;
+    }
+    budget = MIN(now_ms - spool.backfill_ms, 1000) * spool.backfill_kbps;
+    spool.backfill_ms = now_ms;
+
+    /* Send whole lines within budget, only this thread moves head */
+    head = __atomic_load_n(&(spool.header->head), __ATOMIC_ACQUIRE);
+    tail = __atomic_load_n(&(spool.header->tail), __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return;
+    begin = spool.data + head;
+    end = begin + MIN(budget, tail - head);
+    while (end > begin && end[-1] != '\n')
+        --end;
+    if (end == begin)
+        return;
+    if (fwrite(begin, end - begin, 1, stdout) != 1 || fflush(stdout) != 0)
+    {
+        metrics_output_failed = true;
+        return;
+    }
+
+    /* Advance head, starting over once writers have nothing pending */
+    (void)pthread_mutex_lock(&(spool.lock));
+    spool.header->head = head + (end - begin);
+    if (spool.header->head == spool.header->tail)
+        spool.header->head = spool.header->tail = 0;
+    (void)pthread_mutex_unlock(&(spool.lock));
+}
+
+void sink_fini(void)
+{
+    /* Sanity checks */
+    if (!spool.header)
+        return;
+
+    (void)munmap(spool.header, spool.size);
+    if (spool.fd >= 0)
+        close(spool.fd); // also releases lock
+    spool.fd = -1;
+    spool.header = NULL;
+    spool.data = NULL;
+    spool.size = 0;
+}
+
+static bool sink_spool_append(const char *line, size_t length)
+{
+    bool result = false;
+
+    /* Append whole line, drop it if it does not fit */
+    (void)pthread_mutex_lock(&(spool.lock));
+    if (spool.header->tail + length <= spool.header->capacity)
+    {
+        memcpy(spool.data + spool.header->tail, line, length);
+        __atomic_store_n(&(spool.header->tail), spool.header->tail + length,
+                __ATOMIC_RELEASE);
+        result = true;
+    }
+    else
+        ++(spool.header->dropped);
+    (void)pthread_mutex_unlock(&(spool.lock));
+
+    return result;
+}
+
@@ -0,0 +1,58 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   sink.h
+ * Desc:   Metric sink output with disk-backed outage spool header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Environment variable holding "<file>,<MB>[,<backfill KB/s>]" */
+    #define SINK_SPOOL_ENVNAME "SINK_SPOOL"
+
+    /* Spool file layout identification & limits */
+    #define SINK_SPOOL_MAGIC       0x53503446 // "F4PS"
+    #define SINK_SPOOL_VERSION     1
+    #define SINK_SPOOL_MAX_MB      (64 * 1024)
+    #define SINK_BACKFILL_KBPS     256
+
+    /*
+     * Fixed-size spool header, followed by capacity bytes of metric lines;
+     * lines are appended at tail & backfilled from head, both offsets start
+     * over once all is backfilled
+     */
+    typedef struct sink_spool_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t capacity;
+        uint64_t head;
+        uint64_t tail;
+        uint64_t dropped;  // lines not spooled for lack of space
+        uint8_t  reserved[24];
+
+    } sink_spool_header_t;
+
+    /* Exported public functions */
+    bool sink_init(error_context_t *errctx);
+    bool sink_write(const char *line, size_t length);
+    void sink_backfill(uint64_t now_ms);
+    void sink_fini(void);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,173 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   startup_phases.c
+ * Desc:   FMP4 stream per-connection startup phase timings metric
+ */
+
+#include <fmp4.h>
+#include <inttypes.h>
+
+#include "error.h"
+#include "metric.h"
+
+/* Startup phases, each output once per connection */
+typedef enum phase_t
+{
+    PHASE_DNS,
+    PHASE_CONNECT,
+    PHASE_FTYP,
+    PHASE_MOOV,
+    PHASE_MOOF,
+    PHASE_KEYFRAME,
+    PHASE_EGWC,
+    PHASE_COUNT
+
+} phase_t;
+
+static const char *phase_series[PHASE_COUNT] =
+{
+    ".dns", ".connect", ".ftyp", ".moov", ".moof", ".keyframe", ".egwc",
+};
+
+/* Internal metric context */
+typedef struct context_t
+{
+    uint32_t connection;  // phases below belong to
+    uint32_t done;        // bit per phase already output
+
+} context_t;
+
+static metric_context_t startup_phases_context(error_context_t *errctx);
+static bool startup_phases_emit(metric_context_t ctx, const fmp4_box_t *box,
+        error_context_t *errctx);
+static bool startup_phases_keyframe(void);
+static bool startup_phases_output(context_t *ctx, phase_t phase,
+        uint64_t phase_ms, const metric_stream_t *stream,
+        error_context_t *errctx);
+
+static metric_t startup_phases =
+{
+    .envname = "STARTUP_PHASES",
+    .masks   = METRIC_MASK_CONTROL | METRIC_MASK_AUDIO | METRIC_MASK_VIDEO |
+               METRIC_MASK_TIME,
+    .context = startup_phases_context,
+    .emit    = startup_phases_emit,
+};
+
+REGISTER_METRIC(startup_phases);
+
+static metric_context_t
+startup_phases_context(error_context_t *errctx)
+{
+    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    error_save_retval_if(!ctx, errctx, errno, NULL);
+    return (metric_context_t)(ctx);
+}
+
+static bool
+startup_phases_emit(metric_context_t  ctx,
+                    const fmp4_box_t  *box,
+                    error_context_t  *errctx)
+{
+    context_t             *metric_ctx = NULL;
+    const metric_stream_t *stream     = NULL;
+    uint64_t               now_ms     = 0;
+
+    /* Sanity checks */
+    if (!ctx || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast context to internal metric context */
+    metric_ctx = (context_t *)(ctx);
+
+    /* Replayed & offline streams have no connections to time */
+    stream = metrics_stream();
+    if (!stream || stream->connection == 0)
+        return true;
+
+    /* Each connection starts over, output lookup & connect on first box */
+    if (metric_ctx->connection != stream->connection)
+    {
+        metric_ctx->connection = stream->connection;
+        metric_ctx->done = 0;
+        if (stream->resolved_ms && !startup_phases_output(metric_ctx,
+                    PHASE_DNS, stream->resolved_ms, stream, errctx))
+            return false;
+        if (stream->connected_ms && !startup_phases_output(metric_ctx,
+                    PHASE_CONNECT, stream->connected_ms, stream, errctx))
+            return false;
+    }
+
+    /* Nothing left to time on this connection */
+    if (metric_ctx->done == (1u << PHASE_COUNT) - 1)
+        return true;
+
+    /* Phases reached by this box, since connection start */
+    now_ms = metrics_now_ms();
+    switch (ntohl(box->type))
+    {
+        case 0x66747970: // ftyp box
+            return startup_phases_output(metric_ctx, PHASE_FTYP, now_ms,
+                    stream, errctx);
+        case 0x6d6f6f76: // moov box
+            return startup_phases_output(metric_ctx, PHASE_MOOV, now_ms,
+                    stream, errctx);
+        case 0x65677763: // egwc box
+            return startup_phases_output(metric_ctx, PHASE_EGWC, now_ms,
+                    stream, errctx);
+        case 0x6d6f6f66: // moof box
+            if (!startup_phases_output(metric_ctx, PHASE_MOOF, now_ms,
+                        stream, errctx))
+                return false;
+            if (startup_phases_keyframe())
+                return startup_phases_output(metric_ctx, PHASE_KEYFRAME,
+                        now_ms, stream, errctx);
+            return true;
+        default:
+            return true;
+    }
+}
+
+static bool
+startup_phases_keyframe(void)
+{
+    const track_table_t *tracks   = metrics_tracks();
+    const fragment_t    *fragment = metrics_fragment();
+    const track_t       *track    = NULL;
+    size_t               idx      = 0;
+
+    /* First fragment holding a sync sample of any video track */
+    for (idx = 0; idx < fragment->track_count; idx++)
+    {
+        track = track_table_find(tracks, fragment->tracks[idx].track_id);
+        if (track && track->handler == TRACK_HANDLER_VIDEO &&
+                fragment->tracks[idx].keyframe_count)
+            return true;
+    }
+
+    return false;
+}
+
+static bool
+startup_phases_output(context_t             *ctx,
+                      phase_t                phase,
+                      uint64_t               phase_ms,
+                      const metric_stream_t *stream,
+                      error_context_t       *errctx)
+{
+    uint64_t elapsed_ms = 0;
+
+    /* Only first occurrence per connection */
+    if (ctx->done & (1u << phase))
+        return true;
+    ctx->done |= 1u << phase;
+
+    /* Time from connection start, the blind time of metrics for media */
+    if (phase_ms > stream->connect_start_ms)
+        elapsed_ms = phase_ms - stream->connect_start_ms;
+
+    return metric_output(&startup_phases, phase_series[phase], elapsed_ms, 0,
+            metrics_now_ms(), errctx);
+}
+
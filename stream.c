@@ -0,0 +1,719 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   stream.c
+ * Desc:   FMP4 stream worker implementation
+ */
+
+#include <limits.h>
+#include <signal.h>
+#ifdef __linux__
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#endif
+#include <unistd.h>
+
+#include <fmp4.h>
+
+#include "box.h"
+#include "stream.h"
+
+static void wakeup_handler(int signum);
+static void *stream_worker(void *arg);
+static bool on_fmp4_box(const fmp4_box_t *box, void *userdata,
+        error_context_t *errctx);
+static bool stream_admit(stream_t *stream, const fmp4_box_t *box);
+static void *stream_watchdog(void *arg);
+static bool stream_watchdog_timer(error_context_t *errctx);
+static bool stream_watchdog_wait(void);
+static void stream_watchdog_check(stream_t *stream, uint64_t now_ms);
+static uint64_t stream_reconnect_ms(stream_t *stream, uint64_t start_ms);
+
+/* Watchdog of all streams, started & stopped streams are guarded by lock */
+static struct
+{
+    stream_list_t   *list;
+    int              timer_fd;    // -1 where timerfd is unavailable
+    uint64_t         check_ms;
+    uint64_t         stall_ms;
+    uint64_t         timeout_ms;
+    pthread_t        thread;
+    pthread_mutex_t  lock;
+    bool             started;
+    volatile bool    run;
+
+} watchdog = { .timer_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Hibernation of idle streams, disabled if idle time is 0 */
+static struct
+{
+    uint64_t idle_ms;
+    uint64_t probe_ms;
+
+} hibernate = {};
+
+/* Stall duration output, interval is the watchdog check interval */
+static metric_t stream_watchdog_metric =
+{
+    .envname = WATCHDOG_ENVNAME,
+};
+
+/*
+ * Connection libfmp4 makes on a worker thread, seen by wrapping connect() &
+ * getaddrinfo() at link time where supported since libfmp4 exposes neither
+ */
+static __thread struct
+{
+    bool     watching;
+    int      socket_fd;   // last TCP socket connected, 0 if none
+    uint64_t resolved_ms; // first host name resolved, 0 if none
+
+} connecting;
+
+bool stream_init(error_context_t *errctx)
+{
+    struct sigaction  action = {};
+    const char       *config = NULL;
+    char             *comma  = NULL;
+    int               ret    = -1;
+
+    /* Wake-up signal interrupts blocking calls of workers, no SA_RESTART */
+    action.sa_handler = wakeup_handler;
+    sigemptyset(&(action.sa_mask));
+    action.sa_flags = 0;
+    ret = sigaction(SIGUSR1, &action, NULL);
+    error_save_retval_if(ret < 0, errctx, errno, false);
+
+    /* Hibernation is optional, probes sleep no longer than usleep() can */
+    config = getenv(HIBERNATE_ENVNAME);
+    if (config)
+    {
+        hibernate.idle_ms = strtoull(config, &comma, 10);
+        error_save_retval_if(*comma != ',', errctx, EINVAL, false);
+        hibernate.probe_ms = strtoull(comma + 1, NULL, 10);
+        error_save_retval_if(hibernate.idle_ms == 0 ||
+                hibernate.idle_ms == ULLONG_MAX || hibernate.probe_ms == 0 ||
+                hibernate.probe_ms > UINT32_MAX / 1000, errctx, EINVAL, false);
+    }
+
+    return true;
+}
+
+bool
+stream_list_add(stream_list_t   *list,
+                const char      *name,
+                const char      *url,
+                const char      *group,
+                error_context_t *errctx)
+{
+    stream_t *streams = NULL;
+    stream_t *stream  = NULL;
+    size_t    idx     = 0;
+
+    /* Sanity checks */
+    if (!list || !url || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Grow list, workers must not be running yet */
+    streams = (stream_t *)(realloc(list->streams,
+                (list->count + 1) * sizeof(stream_t)));
+    error_save_retval_if(!streams, errctx, errno, false);
+    list->streams = streams;
+    stream = &(streams[list->count]);
+    memset(stream, 0, sizeof(*stream));
+
+    /* Setup stream identity */
+    stream->url = strdup(url);
+    stream->name = name ? strdup(name) : NULL;
+    stream->group = group ? strdup(group) : NULL;
+    if (!stream->url || (name && !stream->name) || (group && !stream->group))
+    {
+        FREE_AND_NULLIFY(stream->url);
+        FREE_AND_NULLIFY(stream->name);
+        FREE_AND_NULLIFY(stream->group);
+        error_save_retval(errctx, ENOMEM, false);
+    }
+    stream->metric.url = stream->url;
+    stream->metric.name = stream->name;
+    stream->metric.id = metrics_hash(stream->url);
+    stream->priority = OVERLOAD_DEFAULT_PRIORITY;
+
+    /*
+     * Tiers of a group are listed upstream first, origin being tier 0, &
+     * renditions of a ladder in any order; kinds never share a group
+     */
+    if (group)
+    {
+        if (strncmp(group, STREAM_GROUP_LADDER,
+                    strlen(STREAM_GROUP_LADDER)) == 0)
+        {
+            stream->metric.group_kind = METRIC_GROUP_LADDER;
+            group += strlen(STREAM_GROUP_LADDER);
+        }
+        else if (strncmp(group, STREAM_GROUP_TIERS,
+                    strlen(STREAM_GROUP_TIERS)) == 0)
+            group += strlen(STREAM_GROUP_TIERS);
+        stream->metric.group = (metrics_hash(group) ^
+                ((uint64_t)(stream->metric.group_kind) << 63)) | 1;
+        for (idx = 0; idx < list->count; idx++)
+            if (streams[idx].metric.group == stream->metric.group)
+                ++(stream->metric.tier);
+    }
+    ++(list->count);
+
+    return true;
+}
+
+bool
+stream_list_load(stream_list_t   *list,
+                 const char      *path,
+                 error_context_t *errctx)
+{
+    FILE   *file                            = NULL;
+    char   *line                            = NULL;
+    size_t  length                          = 0;
+    char    name[MAX_STREAM_NAME_LEN + 1]   = {0};
+    char    url[MAX_STREAM_URL_LEN + 1]     = {0};
+    char    group[MAX_STREAM_GROUP_LEN + 1] = {0};
+    int     priority                        = OVERLOAD_DEFAULT_PRIORITY;
+    int     fields                          = 0;
+    bool    result                          = false;
+
+    /* Sanity checks */
+    if (!list || !path || !errctx)
+        error_save_jump(errctx, EINVAL, CLEANUP);
+
+    /*
+     * Each line lists "<name> <url> [<group> [<priority>]]", blank lines &
+     * '#' comments ignored; lines sharing a group receive one stream at
+     * successive tiers, or renditions of one channel if the group is named
+     * "ladder:<name>", a group of "-" is none
+     */
+    file = fopen(path, "r");
+    error_save_jump_if(!file, errctx, errno, CLEANUP);
+    while (getline(&line, &length, file) > 0)
+    {
+        if (sscanf(line, " %1[#]", name) == 1)
+            continue;
+        priority = OVERLOAD_DEFAULT_PRIORITY;
+        fields = sscanf(line, "%" STRINGIFY(MAX_STREAM_NAME_LEN) "s %"
+                STRINGIFY(MAX_STREAM_URL_LEN) "s %"
+                STRINGIFY(MAX_STREAM_GROUP_LEN) "s %d", name, url, group,
+                &priority);
+        switch (fields)
+        {
+            case EOF: continue;
+            case 2: case 3: case 4: break;
+            default: error_save_jump(errctx, EINVAL, CLEANUP);
+        }
+        error_save_jump_if(priority < 0 || priority >= OVERLOAD_PRIORITIES,
+                errctx, EINVAL, CLEANUP);
+        if (!stream_list_add(list, name, url, fields >= 3 &&
+                    strcmp(group, "-") != 0 ? group : NULL, errctx))
+            goto CLEANUP;
+        list->streams[list->count - 1].priority = (uint32_t)(priority);
+    }
+    error_save_jump_if(list->count == 0, errctx, ENOENT, CLEANUP);
+
+    result = true;
+
+CLEANUP:
+
+    FREE_AND_NULLIFY(line);
+    FCLOSE_AND_NULLIFY(file);
+
+    return result;
+}
+
+bool
+stream_list_capture(stream_list_t   *list,
+                    const char      *path,
+                    bool             header_only,
+                    error_context_t *errctx)
+{
+    stream_t *stream = NULL;
+    size_t    length = 0;
+    size_t    idx    = 0;
+
+    /* Sanity checks */
+    if (!list || !path || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Named streams capture to "<path>.<name>", an unnamed one to path */
+    for (idx = 0; idx < list->count; idx++)
+    {
+        stream = &(list->streams[idx]);
+        length = strlen(path) + (stream->name ? strlen(stream->name) + 1 : 0);
+        stream->capture_path = (char *)(malloc(length + 1));
+        error_save_retval_if(!stream->capture_path, errctx, errno, false);
+        if (stream->name)
+            (void)snprintf(stream->capture_path, length + 1, "%s.%s", path,
+                    stream->name);
+        else
+            (void)snprintf(stream->capture_path, length + 1, "%s", path);
+        stream->capture_header_only = header_only;
+    }
+
+    return true;
+}
+
+void stream_list_free(stream_list_t *list)
+{
+    size_t idx = 0;
+
+    /* Sanity checks */
+    if (!list || !list->streams)
+        return;
+
+    /* Stop workers & release stream identities */
+    for (idx = 0; idx < list->count; idx++)
+    {
+        stream_stop(&(list->streams[idx]));
+        FREE_AND_NULLIFY(list->streams[idx].url);
+        FREE_AND_NULLIFY(list->streams[idx].name);
+        FREE_AND_NULLIFY(list->streams[idx].group);
+        FREE_AND_NULLIFY(list->streams[idx].capture_path);
+    }
+    FREE_AND_NULLIFY(list->streams);
+    list->count = 0;
+}
+
+bool stream_start(stream_t *stream, error_context_t *errctx)
+{
+    sigset_t blocked  = {};
+    sigset_t previous = {};
+    int      ret      = -1;
+
+    /* Sanity checks */
+    if (!stream || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+    if (stream->started)
+        return true;
+
+    /* Workers leave termination signals to the main thread */
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    (void)pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    stream->run = true;
+    (void)pthread_mutex_lock(&(watchdog.lock));
+    ret = pthread_create(&(stream->thread), NULL, stream_worker, stream);
+    stream->started = ret == 0;
+    (void)pthread_mutex_unlock(&(watchdog.lock));
+    (void)pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    error_save_retval_if(ret != 0, errctx, ret, false);
+
+    return true;
+}
+
+void stream_stop(stream_t *stream)
+{
+    /* Sanity checks */
+    if (!stream || !stream->started)
+        return;
+
+    /* Flag worker to stop & interrupt whatever it is blocked on */
+    (void)pthread_mutex_lock(&(watchdog.lock));
+    stream->run = false;
+    (void)pthread_kill(stream->thread, SIGUSR1);
+    stream->started = false;
+    (void)pthread_mutex_unlock(&(watchdog.lock));
+    (void)pthread_join(stream->thread, NULL);
+}
+
+bool stream_watchdog_start(stream_list_t *list, error_context_t *errctx)
+{
+    sigset_t          blocked  = {};
+    sigset_t          previous = {};
+    char             *comma    = NULL;
+    int               ret      = -1;
+
+    /* Sanity checks */
+    if (!list || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+    if (watchdog.started)
+        return true;
+
+    /*
+     * Always force reconnects of stalled streams; output stall durations
+     * only if configured as "<path>,<check ms>[,<stall ms>[,<timeout ms>]]"
+     */
+    watchdog.check_ms = WATCHDOG_INTERVAL_MS;
+    watchdog.stall_ms = WATCHDOG_STALL_MS;
+    watchdog.timeout_ms = STREAM_TIMEOUT_MS;
+    if (metric_config(&stream_watchdog_metric))
+    {
+        watchdog.check_ms = stream_watchdog_metric.interval_ms;
+        if (stream_watchdog_metric.options[0])
+        {
+            watchdog.stall_ms = strtoull(stream_watchdog_metric.options,
+                    &comma, 10);
+            if (*comma == ',')
+                watchdog.timeout_ms = strtoull(comma + 1, NULL, 10);
+        }
+        error_save_retval_if(watchdog.stall_ms == 0 ||
+                watchdog.stall_ms == ULLONG_MAX || watchdog.timeout_ms == 0 ||
+                watchdog.timeout_ms == ULLONG_MAX, errctx, EINVAL, false);
+    }
+
+    /* Timer ticks at check interval regardless of what streams block on */
+    if (!stream_watchdog_timer(errctx))
+        return false;
+
+    /* Watchdog leaves termination signals to the main thread too */
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    (void)pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    watchdog.list = list;
+    watchdog.run = true;
+    ret = pthread_create(&(watchdog.thread), NULL, stream_watchdog, NULL);
+    (void)pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (ret != 0 && watchdog.timer_fd >= 0)
+    {
+        close(watchdog.timer_fd);
+        watchdog.timer_fd = -1;
+    }
+    error_save_retval_if(ret != 0, errctx, ret, false);
+    watchdog.started = true;
+
+    return true;
+}
+
+void stream_watchdog_stop(void)
+{
+    /* Sanity checks */
+    if (!watchdog.started)
+        return;
+
+    /* Interrupt wait for next tick */
+    watchdog.run = false;
+    (void)pthread_kill(watchdog.thread, SIGUSR1);
+    (void)pthread_join(watchdog.thread, NULL);
+    if (watchdog.timer_fd >= 0)
+        close(watchdog.timer_fd);
+    watchdog.timer_fd = -1;
+    watchdog.started = false;
+}
+
+static void wakeup_handler(int signum)
+{
+}
+
+static void *stream_worker(void *arg)
+{
+    stream_t        *stream   = (stream_t *)(arg);
+    fmp4_t           fmp4     = NULL;
+    uint64_t         start_ms = current_time_milliseconds();
+    error_context_t  _errctx  = {};
+    error_context_t *errctx   = &_errctx;
+
+    /* Attribute metric output of this thread to stream */
+    metrics_bind_stream(&(stream->metric));
+
+    /* Initialize metrics, contexts are allocated once media arrives */
+    stream->hibernating = false;
+    if (!metrics_init(&(stream->metric_contexts), errctx))
+    {
+        error_log_saved(errctx);
+        return NULL;
+    }
+
+    /* Open capture, streams keep running without one if that fails */
+    if (stream->capture_path && !capture_open(&(stream->capture),
+                stream->capture_path, stream->name,
+                stream->capture_header_only, errctx))
+        error_log_saved(errctx);
+    errctx->saved = false;
+
+    while (stream->run)
+    {
+        do
+        {
+            /* Time connection phases */
+            ++(stream->metric.connection);
+            stream->metric.connect_start_ms = current_time_milliseconds();
+            stream->timed_out = false;
+            stream->last_callback_ms = stream->metric.connect_start_ms;
+            stream->metric.resolved_ms = stream->metric.connected_ms = 0;
+
+            /* Setup FMP4 stream context, noting lookup & socket it makes */
+            connecting.watching = true;
+            connecting.socket_fd = 0;
+            connecting.resolved_ms = 0;
+            fmp4 = fmp4_create(stream->url, errctx);
+            error_save_break_if(!fmp4, errctx, errno);
+
+            /* Connect to FMP4 stream source */
+            if (!fmp4_connect(fmp4, errctx))
+                error_save_break(errctx, stream->timed_out ? ETIMEDOUT : errno);
+            stream->metric.connected_ms = current_time_milliseconds();
+            stream->metric.resolved_ms = connecting.resolved_ms;
+            stream->metric.socket_fd = connecting.socket_fd;
+            connecting.watching = false;
+
+            /* Receive media frames until error, stop or watchdog timeout */
+            stream->last_callback_ms = stream->metric.connected_ms;
+            while (stream->run && !stream->timed_out &&
+                    fmp4_recv(fmp4, on_fmp4_box, stream, errctx));
+            error_save_break_if(stream->timed_out, errctx, ETIMEDOUT);
+        }
+        while (false);
+
+        /* Output log if error occurred */
+        if (stream->run)
+            error_log_saved(errctx);
+        errctx->saved = false;
+
+        /* Release acquired resources */
+        fmp4_destroy(&fmp4);
+        stream->metric.socket_fd = 0;
+        connecting.watching = false;
+
+        /* Wait before reconnecting, no timeout meanwhile */
+        stream->last_callback_ms = 0;
+        if (stream->run)
+            usleep(stream_reconnect_ms(stream, start_ms) * 1000);
+    }
+
+    /* Release resources acquired by metrics & capture */
+    metrics_fini(&(stream->metric_contexts));
+    capture_close(&(stream->capture));
+
+    return NULL;
+}
+
+static bool
+on_fmp4_box(const fmp4_box_t *box,
+           void            *userdata,
+           error_context_t *errctx)
+{
+    stream_t *stream = NULL;
+
+    /* Sanity checks */
+    if (!box || !userdata || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast userdata to stream pointer */
+    stream = (stream_t *)(userdata);
+    if (!stream->run)
+        return false;
+
+    /* Metrics see the receive time of the box, just like on replay */
+    stream->metric.clock_ms = current_time_milliseconds();
+    stream->hibernating = false;
+
+    /* Record box as received, dropping the capture if writing it fails */
+    if (stream->capture.file && !capture_write(&(stream->capture), box,
+                stream->metric.clock_ms, errctx))
+    {
+        error_log_saved(errctx);
+        errctx->saved = false;
+        capture_close(&(stream->capture));
+    }
+
+    /* Feed FMP4 box data to metrics, unless shed while overloaded */
+    if (stream_admit(stream, box) &&
+            !metrics_feed_data(stream->metric_contexts, box, errctx))
+        return false;
+
+    /* Update stream callback timestamp */
+    stream->last_callback_ms = stream->metric.clock_ms;
+
+    return true;
+}
+
+static bool stream_admit(stream_t *stream, const fmp4_box_t *box)
+{
+    /* Processing changes between fragments only, never within one */
+    if (ntohl(box->type) == BOX_TYPE_MOOF)
+    {
+        stream->mode = overload_mode(stream->priority);
+        stream->skipping = stream->mode == OVERLOAD_SAMPLED &&
+            stream->fragments % overload_sampling() != 0;
+        ++(stream->fragments);
+
+        /*
+         * Fragment fed stands for the ones left out just before it, counts
+         * scale by it & metrics measuring between fragments start over
+         */
+        if (stream->skipping)
+            ++(stream->left_out);
+        else
+        {
+            stream->metric.weight = stream->left_out ? stream->left_out + 1 : 0;
+            stream->left_out = 0;
+        }
+    }
+
+    /*
+     * Tracks are always known, as is the wallclock of the fragment to come,
+     * which precedes its moof; boxes of fragments left out are not fed
+     */
+    switch (ntohl(box->type))
+    {
+        case BOX_TYPE_FTYP: case BOX_TYPE_MOOV: case BOX_TYPE_EGWC: return true;
+        default: return !stream->skipping;
+    }
+}
+
+static bool stream_watchdog_timer(error_context_t *errctx)
+{
+#ifdef __linux__
+    struct itimerspec timer = {};
+    int               ret   = -1;
+
+    /* Periodic timer, missed ticks collapse into one read */
+    watchdog.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    error_save_retval_if(watchdog.timer_fd < 0, errctx, errno, false);
+    timer.it_value.tv_sec = timer.it_interval.tv_sec = watchdog.check_ms / 1000;
+    timer.it_value.tv_nsec = timer.it_interval.tv_nsec =
+        (watchdog.check_ms % 1000) * 1000000;
+    ret = timerfd_settime(watchdog.timer_fd, 0, &timer, NULL);
+    if (ret < 0)
+    {
+        ret = errno;
+        close(watchdog.timer_fd);
+        watchdog.timer_fd = -1;
+        error_save_retval(errctx, ret, false);
+    }
+#endif
+
+    return true;
+}
+
+static bool stream_watchdog_wait(void)
+{
+    uint64_t expirations = 0;
+
+    /* Without timerfd, sleeping for check interval drifts a little */
+    if (watchdog.timer_fd < 0)
+        return usleep(watchdog.check_ms * 1000) == 0;
+
+    return read(watchdog.timer_fd, &expirations, sizeof(expirations)) ==
+        sizeof(expirations);
+}
+
+static void *stream_watchdog(void *arg)
+{
+    uint64_t now_ms  = 0;
+    uint64_t tick_ms = current_time_milliseconds();
+    size_t   idx     = 0;
+
+    while (watchdog.run)
+    {
+        /* Wait for next tick, a wake-up signal interrupts the wait */
+        if (!stream_watchdog_wait())
+            continue;
+
+        /* Ticks coming late tell the daemon is short of CPU */
+        now_ms = current_time_milliseconds();
+        overload_update(now_ms > tick_ms + watchdog.check_ms ?
+                now_ms - tick_ms - watchdog.check_ms : 0, now_ms);
+        tick_ms = now_ms;
+
+        /* Check running streams, none is stopped while checking */
+        (void)pthread_mutex_lock(&(watchdog.lock));
+        for (idx = 0; idx < watchdog.list->count; idx++)
+            if (watchdog.list->streams[idx].started)
+                stream_watchdog_check(&(watchdog.list->streams[idx]), now_ms);
+        (void)pthread_mutex_unlock(&(watchdog.lock));
+    }
+
+    return NULL;
+}
+
+static void stream_watchdog_check(stream_t *stream, uint64_t now_ms)
+{
+    error_context_t  _errctx    = {};
+    error_context_t *errctx     = &_errctx;
+    uint64_t         active_ms  = stream->last_callback_ms;
+    uint64_t         box_ms     = stream->metric.clock_ms;
+    uint64_t         stall_ms   = 0;
+
+    /* Interrupt connection silent for too long, worker then reconnects */
+    if (active_ms && !stream->timed_out && now_ms > active_ms &&
+            now_ms - active_ms >= watchdog.timeout_ms)
+    {
+        stream->timed_out = true;
+        (void)pthread_kill(stream->thread, SIGUSR1);
+    }
+
+    /* Stall lasts since last box, across reconnects, until the next one */
+    if (box_ms && now_ms > box_ms && now_ms - box_ms >= watchdog.stall_ms)
+        stall_ms = now_ms - box_ms;
+    else if (!stream->stalled)
+        return;
+    stream->stalled = stall_ms != 0;
+
+    /* Output stall duration so far, 0 once over, attributed to stream */
+    if (!stream_watchdog_metric.interval_ms)
+        return;
+    metrics_bind_stream(&(stream->metric));
+    if (!metric_output(&stream_watchdog_metric, ".stall_ms", stall_ms, 0,
+                now_ms, errctx))
+        error_log_saved(errctx);
+}
+
+static uint64_t stream_reconnect_ms(stream_t *stream, uint64_t start_ms)
+{
+    uint64_t active_ms = MAX(stream->metric.clock_ms, start_ms);
+    uint64_t now_ms    = current_time_milliseconds();
+
+    /* Streams active lately reconnect soon */
+    if (!hibernate.idle_ms || now_ms < active_ms ||
+            now_ms - active_ms < hibernate.idle_ms)
+        return RECONNECT_INTERVAL_MS;
+    if (stream->hibernating)
+        return hibernate.probe_ms;
+
+    /*
+     * Offline for long, e.g. event not live: drop metric state until media
+     * arrives again & probe seldom, spreading streams gone offline together
+     */
+    stream->hibernating = true;
+    metrics_release(stream->metric_contexts);
+
+    return stream->metric.id % hibernate.probe_ms + 1;
+}
+
+#ifdef __linux__
+int __real_connect(int fd, const struct sockaddr *addr, socklen_t size);
+int __real_getaddrinfo(const char *node, const char *service,
+        const struct addrinfo *hints, struct addrinfo **results);
+
+int __wrap_connect(int fd, const struct sockaddr *addr, socklen_t size)
+{
+    int       ret    = __real_connect(fd, addr, size);
+    int       saved  = errno;
+    int       type   = 0;
+    socklen_t length = sizeof(type);
+
+    /* TCP sockets of workers' transports, connected or still in progress */
+    if (connecting.watching && addr && (addr->sa_family == AF_INET ||
+                addr->sa_family == AF_INET6) &&
+            (ret == 0 || saved == EINPROGRESS) &&
+            getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &length) == 0 &&
+            type == SOCK_STREAM)
+        connecting.socket_fd = fd;
+    errno = saved;
+
+    return ret;
+}
+
+int
+__wrap_getaddrinfo(const char             *node,
+                   const char             *service,
+                   const struct addrinfo  *hints,
+                   struct addrinfo       **results)
+{
+    int ret = __real_getaddrinfo(node, service, hints, results);
+
+    /* First host name a worker's transport resolves ends its lookup */
+    if (connecting.watching && ret == 0 && !connecting.resolved_ms)
+        connecting.resolved_ms = current_time_milliseconds();
+
+    return ret;
+}
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   stream.h
+ * Desc:   FMP4 stream worker interface header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "capture.h"
+#include "common.h"
+#include "error.h"
+#include "metric.h"
+#include "overload.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define STREAM_TIMEOUT_MS     (60 * 1000)
+    #define RECONNECT_INTERVAL_MS (3000)
+
+    /* Watchdog check interval & stall threshold defaults */
+    #define WATCHDOG_INTERVAL_MS  (250)
+    #define WATCHDOG_STALL_MS     (1000)
+    #define WATCHDOG_ENVNAME      "STREAM_WATCHDOG"
+
+    /* Idle time & probe interval of hibernation, "<idle ms>,<probe ms>" */
+    #define HIBERNATE_ENVNAME     "STREAM_HIBERNATE"
+
+    /* Maximum lengths of stream list entry fields */
+    #define MAX_STREAM_NAME_LEN  128
+    #define MAX_STREAM_URL_LEN   1024
+    #define MAX_STREAM_GROUP_LEN 128
+
+    /* Prefixes of group names stating their kind, tiers if none */
+    #define STREAM_GROUP_TIERS   "tier:"
+    #define STREAM_GROUP_LADDER  "ladder:"
+
+    /* Per-stream worker context */
+    typedef struct stream_t
+    {
+        /* Stream identity, name prefixes metric paths in list mode */
+        char             *name;
+        char             *url;
+        char             *group;      // kind prefixed name, NULL if none
+        uint32_t          priority;   // 0 highest, shed last if overloaded
+        metric_stream_t   metric;
+
+        /* List of metrics contexts */
+        metric_context_t *metric_contexts;
+
+        /* Last activity, 0 while waiting to reconnect; watchdog state */
+        volatile uint64_t last_callback_ms;
+        volatile bool     timed_out;
+        bool              stalled;
+
+        /* Idle for long, metric contexts released & reconnects slowed */
+        bool              hibernating;
+
+        /* Processing of current fragment while daemon is overloaded */
+        overload_mode_t   mode;
+        bool              skipping;   // fragment left out of sample
+        uint64_t          fragments;
+        uint32_t          left_out;   // since the last fragment fed
+
+        /* Optional capture of received boxes */
+        char             *capture_path;
+        bool              capture_header_only;
+        capture_t         capture;
+
+        /* Worker thread state */
+        pthread_t         thread;
+        bool              started;
+        volatile bool     run;
+
+    } stream_t;
+
+    /* List of configured streams */
+    typedef struct stream_list_t
+    {
+        stream_t *streams;
+        size_t    count;
+
+    } stream_list_t;
+
+    /* Exported public functions */
+    bool stream_init(error_context_t *errctx);
+    bool stream_list_add(stream_list_t *list, const char *name,
+            const char *url, const char *group, error_context_t *errctx);
+    bool stream_list_load(stream_list_t *list, const char *path,
+            error_context_t *errctx);
+    bool stream_list_capture(stream_list_t *list, const char *path,
+            bool header_only, error_context_t *errctx);
+    void stream_list_free(stream_list_t *list);
+    bool stream_start(stream_t *stream, error_context_t *errctx);
+    void stream_stop(stream_t *stream);
+    bool stream_watchdog_start(stream_list_t *list, error_context_t *errctx);
+    void stream_watchdog_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,126 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   table_reader.c
+ * Desc:   Shared-memory metric table reader for local consumers
+ */
+
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "metric_table.h"
+
+static void usage(const char *command);
+static void signal_handler(int signum);
+static size_t table_dump(const metric_table_t *table, const char *pattern,
+        uint64_t max_age_ms);
+
+/* Global variables & flags */
+bool run = true;
+
+int main(int argc, char *argv[])
+{
+    const char      *path        = NULL;
+    const char      *pattern     = NULL;
+    uint64_t         interval_ms = 0;
+    uint64_t         max_age_ms  = 0;
+    metric_table_t   table       = {};
+    error_context_t  _errctx     = {};
+    error_context_t *errctx      = &_errctx;
+    int              opt         = -1;
+    bool             result      = false;
+
+    /* Parse options */
+    while ((opt = getopt(argc, argv, "w:a:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'w': interval_ms = strtoull(optarg, NULL, 10); break;
+            case 'a': max_age_ms = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    path = argv[optind];
+    pattern = (argc - optind == 2) ? argv[optind + 1] : "*";
+
+    /* Setup signal handlers */
+    signal(SIGINT, signal_handler);
+
+    /* Map table published by daemons */
+    if (!metric_table_map(&table, path, false, errctx))
+        error_save_jump(errctx, errno, CLEANUP);
+
+    /* Output table once, or poll it periodically */
+    do
+    {
+        (void)table_dump(&table, pattern, max_age_ms);
+        fflush(stdout);
+        if (interval_ms)
+            usleep(interval_ms * 1000);
+    }
+    while (run && interval_ms);
+
+    result = true;
+
+CLEANUP:
+
+    metric_table_unmap(&table);
+
+    /* Output log if error occurred */
+    error_log_saved(errctx);
+
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void usage(const char *command)
+{
+    fprintf(stderr, "Usage:\n\t%s [-w <poll interval ms>] [-a <max age ms>] "
+            "<table file> [path pattern]\n\n"
+            "Outputs \"<path> <value> <timestamp>\" for each published metric "
+            "whose path matches the\nshell pattern, in Graphite plaintext "
+            "format.\n", command);
+}
+
+static void signal_handler(int signum)
+{
+    run = false;
+}
+
+static size_t
+table_dump(const metric_table_t *table,
+           const char           *pattern,
+           uint64_t              max_age_ms)
+{
+    metric_table_slot_t slot   = {};
+    uint64_t            now_ms = current_time_milliseconds();
+    size_t              idx    = 0;
+    size_t              count  = 0;
+
+    /* Cycle through slots, taking consistent snapshots */
+    for (idx = 0; idx < table->header->capacity; idx++)
+    {
+        if (!metric_table_snapshot(table, idx, &slot))
+            continue;
+        if (fnmatch(pattern, slot.path, 0) != 0)
+            continue;
+        if (max_age_ms && now_ms > slot.timestamp_ms &&
+                now_ms - slot.timestamp_ms > max_age_ms)
+            continue;
+        printf("%s %.2f %" PRIu64 "\n", slot.path, slot.value,
+                slot.timestamp_ms / 1000);
+        ++count;
+    }
+
+    return count;
+}
+
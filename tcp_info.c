@@ -0,0 +1,129 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   tcp_info.c
+ * Desc:   FMP4 stream connection TCP health metric
+ */
+
+#include <fmp4.h>
+#include <inttypes.h>
+#include <stddef.h>
+#ifdef __linux__
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "error.h"
+#include "metric.h"
+
+/* Internal metric context */
+typedef struct context_t
+{
+    uint64_t prev_time_ms;
+    uint32_t connection;         // counters below belong to
+    uint64_t retransmits;        // totals at previous output
+    uint64_t bytes_received;
+
+} context_t;
+
+static metric_context_t tcp_info_context(error_context_t *errctx);
+static bool tcp_info_emit(metric_context_t ctx, const fmp4_box_t *box,
+        error_context_t *errctx);
+
+static metric_t tcp_info =
+{
+    .envname = "TCP_INFO",
+    .masks   = METRIC_MASK_CONTROL | METRIC_MASK_AUDIO | METRIC_MASK_VIDEO |
+               METRIC_MASK_TIME,
+    .context = tcp_info_context,
+    .emit    = tcp_info_emit,
+};
+
+REGISTER_METRIC(tcp_info);
+
+static metric_context_t
+tcp_info_context(error_context_t *errctx)
+{
+    context_t *ctx = (context_t *)(calloc(1, sizeof(context_t)));
+    error_save_retval_if(!ctx, errctx, errno, NULL);
+    return (metric_context_t)(ctx);
+}
+
+static bool
+tcp_info_emit(metric_context_t  ctx,
+              const fmp4_box_t  *box,
+              error_context_t  *errctx)
+{
+#ifdef __linux__
+    context_t             *metric_ctx = NULL;
+    const metric_stream_t *stream     = NULL;
+    struct tcp_info        info       = {};
+    socklen_t              size       = sizeof(info);
+    uint64_t               now_ms     = 0;
+    uint64_t               received   = 0;
+
+    /* Sanity checks */
+    if (!ctx || !box || !errctx)
+        error_save_retval(errctx, EINVAL, false);
+
+    /* Cast context to internal metric context */
+    metric_ctx = (context_t *)(ctx);
+
+    /* Only connections running over a socket */
+    stream = metrics_stream();
+    if (!stream || stream->socket_fd <= 0)
+        return true;
+
+    /* Check if we are at the end of an interval time frame */
+    now_ms = metrics_now_ms();
+    if (metric_ctx->prev_time_ms == 0)
+        metric_ctx->prev_time_ms = now_ms;
+    if (now_ms - metric_ctx->prev_time_ms < tcp_info.interval_ms)
+        return true;
+    metric_ctx->prev_time_ms = now_ms;
+
+    /* Sample socket, e.g. not TCP if transport runs over something else */
+    if (getsockopt(stream->socket_fd, IPPROTO_TCP, TCP_INFO, &info, &size) < 0)
+        return true;
+    if (size >= offsetof(struct tcp_info, tcpi_bytes_received) +
+            sizeof(info.tcpi_bytes_received))
+        received = info.tcpi_bytes_received;
+
+    /* Counters start over with each connection */
+    if (metric_ctx->connection != stream->connection)
+    {
+        metric_ctx->connection = stream->connection;
+        metric_ctx->retransmits = metric_ctx->bytes_received = 0;
+    }
+
+    /* Output round trip, its variance & window, in ms & segments */
+    if (!metric_output(&tcp_info, ".rtt_ms", info.tcpi_rtt / 1000.0, 3,
+                now_ms, errctx))
+        return false;
+    if (!metric_output(&tcp_info, ".rttvar_ms", info.tcpi_rttvar / 1000.0, 3,
+                now_ms, errctx))
+        return false;
+    if (!metric_output(&tcp_info, ".cwnd", info.tcpi_snd_cwnd, 0, now_ms,
+                errctx))
+        return false;
+    if (!metric_output(&tcp_info, ".rcv_space", info.tcpi_rcv_space, 0,
+                now_ms, errctx))
+        return false;
+
+    /* Output retransmits & bytes received within interval */
+    if (!metric_output(&tcp_info, ".retransmits",
+                info.tcpi_total_retrans - MIN(metric_ctx->retransmits,
+                    info.tcpi_total_retrans), 0, now_ms, errctx))
+        return false;
+    if (!metric_output(&tcp_info, ".bytes_received",
+                received - MIN(metric_ctx->bytes_received, received), 0,
+                now_ms, errctx))
+        return false;
+    metric_ctx->retransmits = info.tcpi_total_retrans;
+    metric_ctx->bytes_received = received;
+#endif
+
+    return true;
+}
+
@@ -0,0 +1,231 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   track.c
+ * Desc:   Track table parsed from movie box implementation
+ */
+
+#include "box.h"
+#include "track.h"
+
+static track_t *track_table_add(track_table_t *table, uint32_t track_id);
+static void track_parse_trak(track_table_t *table, const fmp4_box_t *trak);
+static void track_parse_trex(track_table_t *table, const fmp4_box_t *trex);
+static void track_table_name(track_table_t *table);
+static const char *track_handler_name(uint32_t handler);
+
+void track_table_reset(track_table_t *table)
+{
+    uint32_t generation = 0;
+
+    /* Sanity checks */
+    if (!table)
+        return;
+
+    /* Until a moov is seen, track 1 is taken for video and 2 for audio */
+    generation = table->generation;
+    memset(table, 0, sizeof(*table));
+    table->generation = generation + 1;
+    track_table_add(table, 1)->handler = TRACK_HANDLER_VIDEO;
+    track_table_add(table, 2)->handler = TRACK_HANDLER_AUDIO;
+    track_table_name(table);
+}
+
+bool track_table_parse(track_table_t *table, const fmp4_box_t *moov)
+{
+    track_table_t     parsed = {};
+    box_iter_t        iter   = {};
+    const fmp4_box_t *child  = NULL;
+    const fmp4_box_t *trex   = NULL;
+    box_iter_t        mvex   = {};
+
+    /* Sanity checks */
+    if (!table || !moov)
+        return false;
+
+    /* Tracks first, then their fragment defaults from mvex */
+    iter = box_children(moov, BOX_HEADER_SIZE);
+    while ((child = box_next(&iter)))
+        if (ntohl(child->type) == BOX_TYPE_TRAK)
+            track_parse_trak(&parsed, child);
+    iter = box_children(moov, BOX_HEADER_SIZE);
+    while ((child = box_next(&iter)))
+    {
+        if (ntohl(child->type) != BOX_TYPE_MVEX)
+            continue;
+        mvex = box_children(child, BOX_HEADER_SIZE);
+        while ((trex = box_next(&mvex)))
+            if (ntohl(trex->type) == BOX_TYPE_TREX)
+                track_parse_trex(&parsed, trex);
+    }
+
+    /* Keep previous table if moov holds no usable track */
+    if (parsed.count == 0)
+        return false;
+    track_table_name(&parsed);
+    parsed.generation = table->generation + 1;
+    *table = parsed;
+
+    return true;
+}
+
+int track_table_slot(const track_table_t *table, uint32_t track_id)
+{
+    size_t bucket = 0;
+    size_t probe  = 0;
+    int    slot   = 0;
+
+    /* Sanity checks */
+    if (!table)
+        return -1;
+
+    /* Open addressing, linear probing over a hash twice the table size */
+    bucket = (track_id * 2654435761u) % TRACK_HASH_SIZE;
+    for (probe = 0; probe < TRACK_HASH_SIZE; probe++)
+    {
+        slot = table->hash[(bucket + probe) % TRACK_HASH_SIZE];
+        if (slot == 0)
+            return -1;
+        if (table->tracks[slot - 1].track_id == track_id)
+            return slot - 1;
+    }
+
+    return -1;
+}
+
+const track_t *
+track_table_find(const track_table_t *table,
+                 uint32_t             track_id)
+{
+    int slot = track_table_slot(table, track_id);
+
+    return slot < 0 ? NULL : &(table->tracks[slot]);
+}
+
+static track_t *track_table_add(track_table_t *table, uint32_t track_id)
+{
+    track_t *track  = NULL;
+    size_t   bucket = 0;
+    int      slot   = track_table_slot(table, track_id);
+
+    /* Existing track, or a new slot while there is room */
+    if (slot >= 0)
+        return &(table->tracks[slot]);
+    if (table->count == MAX_TRACKS)
+        return NULL;
+    track = &(table->tracks[table->count++]);
+    memset(track, 0, sizeof(*track));
+    track->track_id = track_id;
+    bucket = (track_id * 2654435761u) % TRACK_HASH_SIZE;
+    while (table->hash[bucket])
+        bucket = (bucket + 1) % TRACK_HASH_SIZE;
+    table->hash[bucket] = table->count;
+
+    return track;
+}
+
+static void track_parse_trak(track_table_t *table, const fmp4_box_t *trak)
+{
+    const fmp4_box_t *tkhd  = NULL;
+    const fmp4_box_t *mdia  = NULL;
+    const fmp4_box_t *mdhd  = NULL;
+    const fmp4_box_t *hdlr  = NULL;
+    const fmp4_box_t *stsd  = NULL;
+    const fmp4_box_t *box   = NULL;
+    track_t          *track = NULL;
+    const uint8_t    *field = NULL;
+    size_t            skip  = 0;
+
+    /* Track identifier from tkhd, its field offset depends on version */
+    tkhd = box_find(trak, BOX_HEADER_SIZE, BOX_TYPE_TKHD);
+    if (!tkhd)
+        return;
+    skip = ((const fmp4_full_box_t *)(tkhd))->version == 1 ? 16 : 8;
+    if (box_payload_size(tkhd, FULL_BOX_HEADER_SIZE) < skip + 4)
+        return;
+    field = (const uint8_t *)(tkhd) + FULL_BOX_HEADER_SIZE + skip;
+    track = track_table_add(table, box_get32(field));
+    if (!track)
+        return;
+
+    /* Timescale from mdhd, handler type from hdlr */
+    mdia = box_find(trak, BOX_HEADER_SIZE, BOX_TYPE_MDIA);
+    if (!mdia)
+        return;
+    mdhd = box_find(mdia, BOX_HEADER_SIZE, BOX_TYPE_MDHD);
+    if (mdhd)
+    {
+        skip = ((const fmp4_full_box_t *)(mdhd))->version == 1 ? 16 : 8;
+        if (box_payload_size(mdhd, FULL_BOX_HEADER_SIZE) >= skip + 4)
+            track->timescale = box_get32((const uint8_t *)(mdhd) +
+                    FULL_BOX_HEADER_SIZE + skip);
+    }
+    hdlr = box_find(mdia, BOX_HEADER_SIZE, BOX_TYPE_HDLR);
+    if (hdlr && box_payload_size(hdlr, FULL_BOX_HEADER_SIZE) >= 8)
+        track->handler = box_get32((const uint8_t *)(hdlr) +
+                FULL_BOX_HEADER_SIZE + 4);
+
+    /* Codec from type of first sample entry in minf/stbl/stsd */
+    box = box_find(mdia, BOX_HEADER_SIZE, BOX_TYPE_MINF);
+    box = box ? box_find(box, BOX_HEADER_SIZE, BOX_TYPE_STBL) : NULL;
+    stsd = box ? box_find(box, BOX_HEADER_SIZE, BOX_TYPE_STSD) : NULL;
+    if (stsd && box_payload_size(stsd, FULL_BOX_HEADER_SIZE) >= 4 + 8)
+        track->codec = box_get32((const uint8_t *)(stsd) +
+                FULL_BOX_HEADER_SIZE + 4 + 4);
+}
+
+static void track_parse_trex(track_table_t *table, const fmp4_box_t *trex)
+{
+    const uint8_t *field = (const uint8_t *)(trex) + FULL_BOX_HEADER_SIZE;
+    track_t       *track = NULL;
+    int            slot  = -1;
+
+    /* Track id, sample description index, duration, size, flags */
+    if (box_payload_size(trex, FULL_BOX_HEADER_SIZE) < 20)
+        return;
+    slot = track_table_slot(table, box_get32(field));
+    if (slot < 0)
+        return;
+    track = &(table->tracks[slot]);
+    track->default_duration = box_get32(field + 8);
+    track->default_size = box_get32(field + 12);
+    track->default_flags = box_get32(field + 16);
+}
+
+static void track_table_name(track_table_t *table)
+{
+    const char *name  = NULL;
+    size_t      idx   = 0;
+    size_t      prev  = 0;
+    bool        taken = false;
+
+    /* First track of a handler keeps plain name, others add track id */
+    for (idx = 0; idx < table->count; idx++)
+    {
+        name = track_handler_name(table->tracks[idx].handler);
+        for (prev = 0, taken = false; prev < idx && !taken; prev++)
+            taken = (strcmp(track_handler_name(table->tracks[prev].handler),
+                        name) == 0);
+        if (taken)
+            (void)snprintf(table->tracks[idx].series,
+                    sizeof(table->tracks[idx].series), ".%s_%u", name,
+                    table->tracks[idx].track_id);
+        else
+            (void)snprintf(table->tracks[idx].series,
+                    sizeof(table->tracks[idx].series), ".%s", name);
+    }
+}
+
+static const char *track_handler_name(uint32_t handler)
+{
+    switch (handler)
+    {
+        case TRACK_HANDLER_VIDEO: return "video";
+        case TRACK_HANDLER_AUDIO: return "audio";
+        case TRACK_HANDLER_TEXT:
+        case TRACK_HANDLER_SUBT: return "text";
+        case TRACK_HANDLER_META: return "meta";
+        default: return "data";
+    }
+}
+
@@ -0,0 +1,85 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   track.h
+ * Desc:   Track table parsed from movie box header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <fmp4.h>
+
+#include "common.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Maximum tracks kept per movie, and size of their lookup hash */
+    #define MAX_TRACKS      16
+    #define TRACK_HASH_SIZE 64
+
+    /* Maximum length of per-track metric series suffix */
+    #define MAX_TRACK_SERIES_LEN 23
+
+    /* Handler types of hdlr box */
+    #define TRACK_HANDLER_VIDEO 0x76696465 // "vide"
+    #define TRACK_HANDLER_AUDIO 0x736f756e // "soun"
+    #define TRACK_HANDLER_TEXT  0x74657874 // "text"
+    #define TRACK_HANDLER_SUBT  0x73756274 // "subt"
+    #define TRACK_HANDLER_META  0x6d657461 // "meta"
+
+    /* Per-track properties & trex sample defaults */
+    typedef struct track_t
+    {
+        uint32_t track_id;
+        uint32_t handler;
+        uint32_t timescale;
+        uint32_t codec;            // type of first sample entry, 0 if none
+        uint32_t default_duration;
+        uint32_t default_size;
+        uint32_t default_flags;
+        char     series[MAX_TRACK_SERIES_LEN + 1]; // e.g. ".video", ".audio_3"
+
+    } track_t;
+
+    /*
+     * Tracks in moov order, hash maps track id to slot + 1; generation
+     * changes whenever slots are reassigned, so per-slot metric state knows
+     * to start over
+     */
+    typedef struct track_table_t
+    {
+        uint32_t generation;
+        size_t   count;
+        track_t  tracks[MAX_TRACKS];
+        uint8_t  hash[TRACK_HASH_SIZE];
+
+    } track_table_t;
+
+    /* Converts media time in track timescale to milliseconds */
+    static inline uint64_t track_to_ms(const track_t *track, uint64_t units)
+    {
+        uint32_t scale = track->timescale;
+
+        return scale ? units / scale * 1000 + units % scale * 1000 / scale : 0;
+    }
+
+    /* Exported public functions */
+    void track_table_reset(track_table_t *table);
+    bool track_table_parse(track_table_t *table, const fmp4_box_t *moov);
+    int track_table_slot(const track_table_t *table, uint32_t track_id);
+    const track_t *track_table_find(const track_table_t *table,
+            uint32_t track_id);
+
+#ifdef __cplusplus
+}
+#endif
+
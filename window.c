@@ -0,0 +1,188 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   window.c
+ * Desc:   Sliding window & EWMA metric aggregates implementation
+ */
+
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "window.h"
+
+static void window_advance(window_t *window, uint64_t now_ms);
+static double window_fold(window_t *window, uint64_t now_ms, double value);
+
+size_t
+window_parse(const char      *options,
+             window_spec_t   *specs,
+             size_t           max,
+             error_context_t *errctx)
+{
+    const char *pos   = options;
+    char       *end   = NULL;
+    size_t      count = 0;
+    int         ret   = -1;
+
+    /* Sanity checks */
+    if (!options || !specs || !errctx)
+        error_save_retval(errctx, EINVAL, SIZE_MAX);
+
+    /* Comma separated spans, suffixed by 'e' for EWMA */
+    while (*pos)
+    {
+        error_save_retval_if(count == max, errctx, E2BIG, SIZE_MAX);
+        specs[count].span_ms = strtoull(pos, &end, 10);
+        error_save_retval_if(end == pos || specs[count].span_ms == 0 ||
+                specs[count].span_ms == ULLONG_MAX, errctx, EINVAL, SIZE_MAX);
+        specs[count].ewma = *end == 'e';
+        end += specs[count].ewma;
+        error_save_retval_if(*end != ',' && *end != '\0', errctx, EINVAL,
+                SIZE_MAX);
+
+        /* Name in whole seconds where possible, e.g. ".10s", ".500ms_ewma" */
+        if (specs[count].span_ms % 1000 == 0)
+            ret = snprintf(specs[count].series, sizeof(specs[count].series),
+                    ".%" PRIu64 "s%s", specs[count].span_ms / 1000,
+                    specs[count].ewma ? "_ewma" : "");
+        else
+            ret = snprintf(specs[count].series, sizeof(specs[count].series),
+                    ".%" PRIu64 "ms%s", specs[count].span_ms,
+                    specs[count].ewma ? "_ewma" : "");
+        error_save_retval_if(ret <= 0 || ret >= sizeof(specs[count].series),
+                errctx, EINVAL, SIZE_MAX);
+
+        ++count;
+        pos = *end ? end + 1 : end;
+    }
+
+    return count;
+}
+
+void window_init(window_t *window, const window_spec_t *spec)
+{
+    /* Sanity checks */
+    if (!window || !spec)
+        return;
+
+    /* Slots no finer than a millisecond */
+    memset(window, 0, sizeof(*window));
+    window->spec = *spec;
+    window->slot_ms = MAX(spec->span_ms / WINDOW_SLOTS, 1);
+}
+
+void window_add(window_t *window, uint64_t now_ms, double value)
+{
+    size_t slot = 0;
+
+    /* Sanity checks */
+    if (!window)
+        return;
+
+    if (window->start_ms == 0)
+        window->start_ms = window->ewma_ms = now_ms;
+    if (!window->spec.ewma)
+    {
+        window_advance(window, now_ms);
+        slot = window->head % WINDOW_SLOTS;
+        window->sums[slot] += value;
+        ++(window->counts[slot]);
+    }
+    window->sum += value;
+    ++(window->count);
+}
+
+double window_rate(window_t *window, uint64_t now_ms)
+{
+    uint64_t covered_ms = 0;
+
+    /* Sanity checks */
+    if (!window)
+        return 0;
+
+    /* EWMA of rate since last query */
+    if (window->spec.ewma)
+    {
+        if (window->start_ms == 0 || now_ms <= window->ewma_ms)
+            return window->ewma;
+        return window_fold(window, now_ms, window->sum * 1000 /
+                (double)(now_ms - window->ewma_ms));
+    }
+
+    /* Sum per second of span, or of time since first value until filled */
+    if (window->start_ms == 0 || now_ms <= window->start_ms)
+        return 0;
+    window_advance(window, now_ms);
+    covered_ms = MIN(now_ms - window->start_ms, window->spec.span_ms);
+    return window->sum * 1000 / (double)(covered_ms);
+}
+
+double window_mean(window_t *window, uint64_t now_ms)
+{
+    /* Sanity checks */
+    if (!window)
+        return 0;
+
+    /* EWMA of mean since last query, kept as is if nothing was added */
+    if (window->spec.ewma)
+    {
+        if (window->count == 0)
+            return window->ewma;
+        return window_fold(window, now_ms, window->sum / window->count);
+    }
+
+    window_advance(window, now_ms);
+    return window->count ? window->sum / window->count : 0;
+}
+
+static void window_advance(window_t *window, uint64_t now_ms)
+{
+    uint64_t head = now_ms / window->slot_ms;
+    size_t   slot = 0;
+
+    /* Values of a clock stepping back go to newest slot */
+    if (head <= window->head)
+        return;
+
+    /* Expire slots passed since newest, all of them after a long gap */
+    if (head - window->head >= WINDOW_SLOTS)
+    {
+        memset(window->sums, 0, sizeof(window->sums));
+        memset(window->counts, 0, sizeof(window->counts));
+        window->sum = 0;
+        window->count = 0;
+        window->head = head;
+        return;
+    }
+    while (window->head < head)
+    {
+        slot = ++(window->head) % WINDOW_SLOTS;
+        window->sum -= window->sums[slot];
+        window->count -= window->counts[slot];
+        window->sums[slot] = 0;
+        window->counts[slot] = 0;
+    }
+}
+
+static double window_fold(window_t *window, uint64_t now_ms, double value)
+{
+    double alpha = 1;
+
+    /* Weight by elapsed time, so irregular queries decay alike */
+    if (window->has_ewma && now_ms > window->ewma_ms)
+        alpha = 1 - exp(-(double)(now_ms - window->ewma_ms) /
+                (double)(window->spec.span_ms));
+    if (window->has_ewma)
+        window->ewma += alpha * (value - window->ewma);
+    else
+        window->ewma = value;
+    window->has_ewma = true;
+    window->ewma_ms = MAX(window->ewma_ms, now_ms);
+    window->sum = 0;
+    window->count = 0;
+
+    return window->ewma;
+}
+
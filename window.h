@@ -0,0 +1,71 @@
+/*
+ * Author: Mave Rick
+ * Date:   2026/10/18
+ * File:   window.h
+ * Desc:   Sliding window & EWMA metric aggregates header
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Maximum extra windows per metric, and ring slots per window */
+    #define MAX_WINDOWS  4
+    #define WINDOW_SLOTS 32
+
+    /* Maximum length of window series suffix, e.g. ".60s_ewma" */
+    #define MAX_WINDOW_SERIES_LEN 15
+
+    /* Window configured as "<span ms>" or, for EWMA, "<span ms>e" */
+    typedef struct window_spec_t
+    {
+        uint64_t span_ms;  // window length, or EWMA time constant
+        bool     ewma;
+        char     series[MAX_WINDOW_SERIES_LEN + 1];
+
+    } window_spec_t;
+
+    /*
+     * Values added over time; sliding windows bucket them into a ring of
+     * slots spanning the window, EWMA folds those added since last query
+     * into an average weighted by elapsed time
+     */
+    typedef struct window_t
+    {
+        window_spec_t spec;
+        uint64_t      slot_ms;            // time covered per ring slot
+        uint64_t      head;               // absolute index of newest slot
+        uint64_t      start_ms;           // first value, 0 if none yet
+        double        sum;                // of ring, or pending for EWMA
+        uint64_t      count;
+        double        sums[WINDOW_SLOTS];
+        uint32_t      counts[WINDOW_SLOTS];
+        double        ewma;
+        uint64_t      ewma_ms;            // last fold
+        bool          has_ewma;
+
+    } window_t;
+
+    /* Exported public functions */
+    size_t window_parse(const char *options, window_spec_t *specs,
+            size_t max, error_context_t *errctx);
+    void window_init(window_t *window, const window_spec_t *spec);
+    void window_add(window_t *window, uint64_t now_ms, double value);
+    double window_rate(window_t *window, uint64_t now_ms);
+    double window_mean(window_t *window, uint64_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+